@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace minirisk
+{
+
+    struct Tape;
+
+    // Number recording on a Tape the operations it is involved in, so that the derivatives
+    // of a result with respect to the inputs can be computed in a single backward sweep
+    // (reverse mode algorithmic differentiation). An AReal without tape is a constant.
+    struct AReal
+    {
+        AReal(double value = 0.0) : m_value(value), m_index(0), m_tape(nullptr) {}
+
+        double value() const { return m_value; }
+
+        double m_value;
+        size_t m_index; // position on the tape, meaningful only if m_tape is set
+        Tape *m_tape;
+    };
+
+    struct Tape
+    {
+        // create an independent variable
+        AReal input(double value)
+        {
+            return record(value, nullptr, 0.0, nullptr, 0.0);
+        }
+
+        // number of nodes recorded so far
+        size_t size() const { return m_nodes.size(); }
+
+        // discard all the nodes recorded after the first n
+        void rewind(size_t n) { m_nodes.resize(n); }
+
+        // Propagate the adjoint of out through the nodes recorded from position 'from' onwards.
+        // For each node i < from which out depends on, call f(i, d(out)/d(node i)).
+        // The cost is proportional to the number of nodes recorded after 'from',
+        // not to the number of nodes before it.
+        template <typename F>
+        void backward(const AReal &out, size_t from, F f)
+        {
+            if (!out.m_tape)
+                return;
+            if (out.m_index < from)
+            {
+                f(out.m_index, 1.0);
+                return;
+            }
+
+            m_adjoints.resize(m_nodes.size(), 0.0);
+            std::fill(m_adjoints.begin() + from, m_adjoints.end(), 0.0);
+            m_touched.clear();
+
+            m_adjoints[out.m_index] = 1.0;
+            for (size_t k = out.m_index + 1; k-- > from;)
+            {
+                const double adj = m_adjoints[k];
+                if (adj == 0.0)
+                    continue;
+                const node_t &n = m_nodes[k];
+                for (unsigned j = 0; j < n.m_nparents; ++j)
+                {
+                    size_t p = n.m_parent[j];
+                    if (p < from && !m_touched_flag[p])
+                    {
+                        m_touched_flag[p] = true;
+                        m_touched.push_back(p);
+                    }
+                    m_adjoints[p] += adj * n.m_partial[j];
+                }
+            }
+
+            // report and reset the adjoints of the nodes before 'from', so they are clean for the next sweep
+            for (size_t p : m_touched)
+            {
+                f(p, m_adjoints[p]);
+                m_adjoints[p] = 0.0;
+                m_touched_flag[p] = false;
+            }
+        }
+
+        // Record a node with value v depending on up to two parents, with the given partial derivatives.
+        // Constant parents (without tape) are skipped.
+        AReal record(double v, const AReal *a, double da, const AReal *b, double db)
+        {
+            node_t n;
+            n.m_nparents = 0;
+            if (a && a->m_tape)
+            {
+                n.m_parent[n.m_nparents] = a->m_index;
+                n.m_partial[n.m_nparents++] = da;
+            }
+            if (b && b->m_tape)
+            {
+                n.m_parent[n.m_nparents] = b->m_index;
+                n.m_partial[n.m_nparents++] = db;
+            }
+            m_nodes.push_back(n);
+            if (m_touched_flag.size() < m_nodes.size())
+                m_touched_flag.resize(m_nodes.size(), false);
+
+            AReal res(v);
+            res.m_index = m_nodes.size() - 1;
+            res.m_tape = this;
+            return res;
+        }
+
+    private:
+        struct node_t
+        {
+            size_t m_parent[2];
+            double m_partial[2];
+            unsigned m_nparents;
+        };
+
+        std::vector<node_t> m_nodes;
+        std::vector<double> m_adjoints;
+        std::vector<bool> m_touched_flag;
+        std::vector<size_t> m_touched;
+    };
+
+    namespace aad_detail
+    {
+        inline Tape *tape_of(const AReal &a, const AReal &b)
+        {
+            return a.m_tape ? a.m_tape : b.m_tape;
+        }
+
+        // record a binary operation, unless both operands are constants
+        inline AReal binary(const AReal &a, const AReal &b, double v, double da, double db)
+        {
+            Tape *t = tape_of(a, b);
+            return t ? t->record(v, &a, da, &b, db) : AReal(v);
+        }
+
+        inline AReal unary(const AReal &a, double v, double da)
+        {
+            return a.m_tape ? a.m_tape->record(v, &a, da, nullptr, 0.0) : AReal(v);
+        }
+    }
+
+    inline AReal operator+(const AReal &a, const AReal &b)
+    {
+        return aad_detail::binary(a, b, a.m_value + b.m_value, 1.0, 1.0);
+    }
+
+    inline AReal operator-(const AReal &a, const AReal &b)
+    {
+        return aad_detail::binary(a, b, a.m_value - b.m_value, 1.0, -1.0);
+    }
+
+    inline AReal operator*(const AReal &a, const AReal &b)
+    {
+        return aad_detail::binary(a, b, a.m_value * b.m_value, b.m_value, a.m_value);
+    }
+
+    inline AReal operator/(const AReal &a, const AReal &b)
+    {
+        return aad_detail::binary(a, b, a.m_value / b.m_value, 1.0 / b.m_value, -a.m_value / (b.m_value * b.m_value));
+    }
+
+    inline AReal operator-(const AReal &a)
+    {
+        return aad_detail::unary(a, -a.m_value, -1.0);
+    }
+
+    inline AReal exp(const AReal &a)
+    {
+        double v = std::exp(a.m_value);
+        return aad_detail::unary(a, v, v);
+    }
+
+} // namespace minirisk
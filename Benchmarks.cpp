@@ -0,0 +1,447 @@
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "CurveDiscount.h"
+#include "MarketDataServer.h"
+#include "PortfolioColumns.h"
+#include "PortfolioStatic.h"
+#include "PortfolioUtils.h"
+#include "TestFixtures.h"
+#include "TradePayment.h"
+
+using namespace ::minirisk;
+
+// Micro benchmarks of the performance critical parts of the library.
+// Timings are the best of a few repetitions, to reduce the noise.
+
+const unsigned repetitions = 5;
+
+template <typename F>
+double best_time(F f)
+{
+    double best = 1e99;
+    for (unsigned r = 0; r < repetitions; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+void report(const string &name, size_t n, const string &unit, double seconds)
+{
+    std::cout << std::left << std::setw(40) << name << std::right << std::setw(12) << std::fixed << std::setprecision(0) << n / seconds << " " << unit << "/sec\n";
+}
+
+// The line parser used before my_ifstream read the file in blocks: every line is copied into
+// a string and wrapped in a stream, every token is extracted into a new string and parsed
+// by its own istringstream. Kept as a reference for the benchmark.
+struct legacy_ifstream
+{
+    legacy_ifstream(const string &fn) : m_if(fn) {}
+
+    bool read_line()
+    {
+        std::getline(m_if, m_line);
+        m_line_stream.str(m_line);
+        m_line_stream.clear();
+        return m_line.length() > 0;
+    }
+
+    string read_token()
+    {
+        string tmp;
+        std::getline(m_line_stream, tmp, separator);
+        return tmp;
+    }
+
+    template <typename T>
+    void read(T &v)
+    {
+        std::istringstream(read_token()) >> v;
+    }
+
+    void read(double &v)
+    {
+        uint64_t u;
+        std::istringstream(read_token()) >> std::hex >> u;
+        std::memcpy(&v, &u, sizeof(v));
+    }
+
+    void read(Date &v)
+    {
+        string tmp = read_token();
+        v.init(std::atoi(tmp.substr(0, 4).c_str()), std::atoi(tmp.substr(4, 2).c_str()), std::atoi(tmp.substr(6, 2).c_str()));
+    }
+
+private:
+    std::ifstream m_if;
+    string m_line;
+    std::istringstream m_line_stream;
+};
+
+void bench_tokenizer(const string &filename, size_t n)
+{
+    double checksum_legacy = 0.0, checksum = 0.0;
+
+    double t_legacy = best_time([&]()
+                                {
+        checksum_legacy = 0.0;
+        legacy_ifstream is(filename);
+        while (is.read_line())
+        {
+            guid_t id;
+            double quantity;
+            string ccy;
+            Date delivery;
+            is.read(id);
+            is.read(quantity);
+            is.read(ccy);
+            is.read(delivery);
+            checksum_legacy += quantity + delivery.get_serial();
+        } });
+
+    double t_new = best_time([&]()
+                             {
+        checksum = 0.0;
+        my_ifstream is(filename);
+        while (is.read_line())
+        {
+            guid_t id;
+            double quantity;
+            string ccy;
+            Date delivery;
+            is >> id >> quantity >> ccy >> delivery;
+            checksum += quantity + delivery.get_serial();
+        } });
+
+    MYASSERT(checksum == checksum_legacy, "The tokenizers parsed different values");
+    report("Parse lines, legacy", n, "lines", t_legacy);
+    report("Parse lines, my_ifstream", n, "lines", t_new);
+
+    portfolio_t portfolio;
+    double t_objects = best_time([&]()
+                                 { portfolio = load_portfolio(filename); });
+    report("load_portfolio, objects", n, "lines", t_objects);
+
+    ThreadPool pool;
+    portfolio_t portfolio_mt;
+    double t_objects_mt = best_time([&]()
+                                    { portfolio_mt = load_portfolio(filename, pool); });
+    MYASSERT(portfolio_mt.size() == portfolio.size(), "The parallel loader read " << portfolio_mt.size() << " trades instead of " << portfolio.size());
+    report("load_portfolio, objects, " + std::to_string(pool.size()) + " threads", n, "lines", t_objects_mt);
+
+    portfolio_columns_t columns;
+    double t_columns = best_time([&]()
+                                 { load_portfolio(filename, columns); });
+    report("load_portfolio, columns", n, "lines", t_columns);
+}
+
+// The serial to date conversion used before Date::serial_to_date was made constant time: a linear
+// search of the year (up to 300 steps) followed by a linear search of the month. Kept as a
+// reference for the benchmark, with the month search bounded (the original read past the
+// table for December dates).
+struct legacy_serial_to_date
+{
+    legacy_serial_to_date()
+    {
+        for (unsigned i = 0, s = 0, y = Date::first_year; i < days_epoch.size(); ++i, ++y)
+        {
+            days_epoch[i] = s;
+            s += 365 + (Date::is_leap_year(y) ? 1 : 0);
+        }
+    }
+
+    void operator()(unsigned serial, unsigned &year, unsigned &month, unsigned &day) const
+    {
+        unsigned y = Date::first_year;
+        while (serial >= days_epoch[y - Date::first_year + 1])
+        {
+            ++y;
+            if (y == 2199)
+                break;
+        }
+        year = y;
+
+        unsigned days_in_year = serial - days_epoch[year - Date::first_year];
+        bool adjusted = false;
+        if (Date::is_leap_year(year) && days_in_year > 58)
+        {
+            days_in_year -= 1;
+            adjusted = true;
+        }
+
+        month = 1;
+        while (month < 12 && days_in_year >= days_ytd[month])
+            ++month;
+
+        day = days_in_year - days_ytd[month - 1] + 1;
+        if (adjusted && days_in_year == 58)
+            day += 1;
+    }
+
+private:
+    std::array<unsigned, Date::n_years> days_epoch;
+    const std::array<unsigned, 12> days_ytd{{0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334}};
+};
+
+void bench_dates()
+{
+    // every date from 1-Jan-1900 to 31-Dec-2199
+    const unsigned n = Date::compute_serial(Date::last_year - 1, 12, 31) + 1;
+    legacy_serial_to_date legacy;
+
+    unsigned long checksum_legacy = 0, checksum = 0;
+    double t_legacy = best_time([&]()
+                                {
+        checksum_legacy = 0;
+        for (unsigned s = 0; s < n; ++s)
+        {
+            unsigned y, m, d;
+            legacy(s, y, m, d);
+            checksum_legacy += y * 10000 + m * 100 + d;
+        } });
+
+    double t_new = best_time([&]()
+                             {
+        checksum = 0;
+        for (unsigned s = 0; s < n; ++s)
+        {
+            unsigned y, m, d;
+            Date::serial_to_date(s, y, m, d);
+            checksum += y * 10000 + m * 100 + d;
+        } });
+
+    MYASSERT(checksum == checksum_legacy, "The serial to date conversions gave different dates");
+    report("serial_to_date, legacy", n, "dates", t_legacy);
+    report("serial_to_date", n, "dates", t_new);
+}
+
+// The text conversions of dates used before the bulk kernels: three substrings parsed by atoi,
+// and a string assembled with std::to_string and an ostringstream padding month and day.
+// Kept as a reference for the benchmark.
+unsigned legacy_parse_date(const string &text)
+{
+    return Date(std::atoi(text.substr(0, 4).c_str()), std::atoi(text.substr(4, 2).c_str()), std::atoi(text.substr(6, 2).c_str())).get_serial();
+}
+
+string legacy_padding_dates(unsigned month_or_day)
+{
+    std::ostringstream os;
+    os << std::setw(2) << std::setfill('0') << month_or_day;
+    return os.str();
+}
+
+string legacy_format_date(unsigned serial)
+{
+    unsigned y, m, d;
+    Date::serial_to_date(serial, y, m, d);
+    return std::to_string(y) + legacy_padding_dates(m) + legacy_padding_dates(d);
+}
+
+void bench_date_text(size_t n)
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<unsigned> serial(0, Date::compute_serial(Date::last_year - 1, 12, 31));
+    std::vector<unsigned> serials(n);
+    for (auto &s : serials)
+        s = serial(rng);
+
+    // format, in a buffer of dates stored back to back
+    std::vector<string> legacy_texts(n);
+    double t_format_legacy = best_time([&]()
+                                       {
+        for (size_t i = 0; i < n; ++i)
+            legacy_texts[i] = legacy_format_date(serials[i]); });
+
+    std::vector<char> texts(n * Date::text_size);
+    double t_format = best_time([&]()
+                                { Date::format_serials(serials.data(), n, texts.data()); });
+
+    for (size_t i = 0; i < n; ++i)
+        MYASSERT(legacy_texts[i] == string(texts.data() + i * Date::text_size, Date::text_size), "The date formatters gave different texts");
+    report("format dates, legacy", n, "dates", t_format_legacy);
+    report("format dates, bulk", n, "dates", t_format);
+
+    // parse the texts back
+    std::vector<unsigned> parsed_legacy(n), parsed(n);
+    double t_parse_legacy = best_time([&]()
+                                      {
+        for (size_t i = 0; i < n; ++i)
+            parsed_legacy[i] = legacy_parse_date(legacy_texts[i]); });
+
+    double t_parse = best_time([&]()
+                               { Date::parse_serials(texts.data(), n, parsed.data()); });
+
+    MYASSERT(parsed_legacy == serials && parsed == serials, "The date parsers gave different serials");
+    report("parse dates, legacy", n, "dates", t_parse_legacy);
+    report("parse dates, bulk", n, "dates", t_parse);
+}
+
+void bench_df_grid(size_t n)
+{
+    std::shared_ptr<const MarketDataServer> mds = make_market_data();
+    constexpr Date today = 20170805_date;
+    const unsigned last_day = 10 * 365; // last pillar
+
+    Market mkt(mds, today), mkt_grid(mds, today);
+    mkt_grid.set_df_grid(true);
+    auto disc = mkt.get_discount_curve("IR.USD");
+    auto disc_grid = mkt_grid.get_discount_curve("IR.USD");
+
+    // both modes agree to the last bit on every day, pillar days included
+    for (unsigned d = 0; d <= last_day; ++d)
+    {
+        double df = disc->df(Date::from_serial(today.get_serial() + d));
+        double df_grid = disc_grid->df(Date::from_serial(today.get_serial() + d));
+        MYASSERT(std::memcmp(&df, &df_grid, sizeof(df)) == 0, "The dense grid gave a different discount factor " << df_grid << " instead of " << df << " on day " << d);
+    }
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<unsigned> day(0, last_day);
+    std::vector<Date> dates(n);
+    for (auto &t : dates)
+        t = Date::from_serial(today.get_serial() + day(rng));
+
+    double checksum = 0.0, checksum_grid = 0.0;
+    double t_search = best_time([&]()
+                                {
+        checksum = 0.0;
+        for (const Date &t : dates)
+            checksum += disc->df(t); });
+    double t_grid = best_time([&]()
+                              {
+        checksum_grid = 0.0;
+        for (const Date &t : dates)
+            checksum_grid += disc_grid->df(t); });
+    MYASSERT(checksum == checksum_grid, "The dense grid gave different discount factors");
+
+    // df_batch gives the discount factors of df, within a few ulps when vectorized (see ICurveDiscount::df_batch)
+    std::vector<double> dfs(n), dfs_grid(n);
+    double t_batch = best_time([&]()
+                               { disc->df_batch(dates, dfs); });
+    double t_batch_grid = best_time([&]()
+                                    { disc_grid->df_batch(dates, dfs_grid); });
+    for (size_t i = 0; i < n; ++i)
+    {
+        double df = disc->df(dates[i]);
+        MYASSERT(std::memcmp(&df, &dfs_grid[i], sizeof(df)) == 0, "df_batch on the dense grid gave " << dfs_grid[i] << " instead of " << df << " on " << dates[i].to_string());
+#if defined(__AVX2__)
+        MYASSERT(std::abs(df - dfs[i]) <= 4 * std::numeric_limits<double>::epsilon() * df, "df_batch gave " << dfs[i] << " instead of " << df << " on " << dates[i].to_string());
+#else
+        MYASSERT(std::memcmp(&df, &dfs[i], sizeof(df)) == 0, "df_batch gave " << dfs[i] << " instead of " << df << " on " << dates[i].to_string());
+#endif
+    }
+
+    std::cout << "Dense discount factor grid: " << (last_day + 1) * sizeof(double) << " bytes per curve\n";
+    report("df, search and exp", n, "dfs", t_search);
+    report("df, dense grid", n, "dfs", t_grid);
+    report("df_batch, search and exp", n, "dfs", t_batch);
+    report("df_batch, dense grid", n, "dfs", t_batch_grid);
+}
+
+void bench_netting(size_t n)
+{
+    std::shared_ptr<const MarketDataServer> mds = make_market_data();
+    constexpr Date today = 20170805_date;
+
+    portfolio_t portfolio = make_payments(n, today);
+    std::vector<ppricer_t> pricers = get_pricers(portfolio);
+    portfolio_columns_t columns = to_columns(portfolio);
+
+    portfolio_values_t prices, prices_netted;
+    double t_pricers = best_time([&]()
+                                 {
+        Market mkt(mds, today);
+        prices = compute_prices(pricers, mkt); });
+    double t_netted = best_time([&]()
+                                {
+        Market mkt(mds, today);
+        prices_netted = compute_prices(columns, mkt); });
+
+    // the same prices to the last bit, unless df_batch is vectorized (see ICurveDiscount::df_batch)
+    for (size_t i = 0; i < n; ++i)
+    {
+        double price = prices[i].first, price_netted = prices_netted[i].first;
+#if defined(__AVX2__)
+        MYASSERT(std::abs(price - price_netted) <= 8 * std::numeric_limits<double>::epsilon() * std::abs(price), "The netted pricer gave a different price " << price_netted << " instead of " << price << " for trade " << i);
+#else
+        MYASSERT(std::memcmp(&price, &price_netted, sizeof(price)) == 0, "The netted pricer gave a different price " << price_netted << " instead of " << price << " for trade " << i);
+#endif
+    }
+    std::cout << "Distinct cashflows: " << net_cashflows(columns.view()).size() << " for " << n << " payments\n";
+    report("compute_prices, one pricer per trade", n, "trades", t_pricers);
+    report("compute_prices, netted cashflows", n, "trades", t_netted);
+}
+
+void bench_static_dispatch(size_t n)
+{
+    std::shared_ptr<const MarketDataServer> mds = make_market_data();
+    constexpr Date today = 20170805_date;
+    portfolio_t portfolio = make_payments(n, today);
+
+    // building the pricers and pricing, as every revaluation of a loaded portfolio does
+    portfolio_values_t prices, prices_static;
+    double t_virtual = best_time([&]()
+                                 {
+        Market mkt(mds, today);
+        prices = compute_prices(get_pricers(portfolio), mkt); });
+    double t_static = best_time([&]()
+                                {
+        Market mkt(mds, today);
+        prices_static = compute_prices(static_portfolio_t(portfolio), mkt); });
+    MYASSERT(prices == prices_static, "The static pricers gave different prices");
+    report("pricers and prices, virtual", n, "trades", t_virtual);
+    report("pricers and prices, static", n, "trades", t_static);
+
+    // pricing only, with pricers built beforehand
+    std::vector<ppricer_t> pricers = get_pricers(portfolio);
+    static_portfolio_t static_portfolio(portfolio);
+    t_virtual = best_time([&]()
+                          {
+        Market mkt(mds, today);
+        prices = compute_prices(pricers, mkt); });
+    t_static = best_time([&]()
+                         {
+        Market mkt(mds, today);
+        prices_static = compute_prices(static_portfolio, mkt); });
+    MYASSERT(prices == prices_static, "The static pricers gave different prices");
+    report("compute_prices, virtual", n, "trades", t_virtual);
+    report("compute_prices, static", n, "trades", t_static);
+}
+
+int main(int argc, const char **argv)
+{
+    size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+
+    try
+    {
+        temp_file_t file("benchmark_portfolio.tmp");
+        const string &filename = file.name;
+        write_portfolio_file(filename, n);
+        bench_tokenizer(filename, n);
+        bench_dates();
+        bench_date_text(n);
+        bench_df_grid(n);
+        bench_netting(n);
+        bench_static_dispatch(n);
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n";
+        return -1;
+    }
+}
@@ -1,5 +1,6 @@
 #include "CurveDiscount.h"
 #include "Market.h"
+#include "VecMath.h"
 #include <algorithm>
 #include <cmath>
 #include <stdexcept>
@@ -13,56 +14,37 @@ namespace minirisk
         // Extract currency code assuming curve_name format is "IR.USD"
         std::string currency = curve_name.substr(curve_name.size() - 3);
 
-        // Construct regex pattern to match relevant rates for the curve
-        std::string pattern = "^IR\\.[0-9]+[DWMY]\\." + currency + "$";
+        // Retrieve the pillars of the curve from the market, sorted by tenor, fetching from
+        // the market data server the ones not yet loaded
+        const std::vector<risk_factor_id_t> &pillars = mkt->symbols().ir_pillars(currency);
+        auto risk_factors = mkt->fetch_risk_factors(pillars);
+        MYASSERT(risk_factors.size() > 1, "At least two pillars are needed to build curve " << curve_name << ", got " << risk_factors.size());
 
-        // Retrieve all relevant risk factors from the market
-        auto risk_factors = mkt->get_risk_factors(pattern);
-
-        // Convert tenors to days and store rates
         for (const auto &rf : risk_factors)
         {
-            double tenor_days = convert_tenor_to_days(rf.first); // Convert tenor string to days
-            m_rates.emplace_back(tenor_days, rf.second);
+            risk_factor_id_t id = mkt->risk_factor_id(rf.first);
+            m_days.push_back(mkt->symbols().key(id).tenor_days);
+            m_rates.push_back(rf.second);
+            m_pillar_names.push_back(rf.first);
+            m_pillar_ids.push_back(id);
         }
 
-        // Sort rates based on tenor days
-        std::sort(m_rates.begin(), m_rates.end());
-
         // Precompute local rates for interpolation
         compute_local_rates();
-    }
 
-    double CurveDiscount::convert_tenor_to_days(const std::string &tenor) const
-    {
-        // Assume tenor format is "1W", "1M", "2Y", etc.
-        char unit = tenor.back();                                 // Get the last character, which denotes the unit
-        int value = std::stoi(tenor.substr(0, tenor.size() - 1)); // Extract the numeric value
-
-        switch (unit)
-        {
-        case 'D':
-            return value;
-        case 'W':
-            return value * 7;
-        case 'M':
-            return value * 30;
-        case 'Y':
-            return value * 365;
-        default:
-            throw std::invalid_argument("Unsupported tenor unit: " + std::string(1, unit));
-        }
+        if (mkt->df_grid())
+            compute_grid();
     }
 
     void CurveDiscount::compute_local_rates()
     {
         for (size_t i = 0; i < m_rates.size() - 1; ++i)
         {
-            double Ti = m_rates[i].first;
-            double Ti1 = m_rates[i + 1].first;
+            double Ti = m_days[i];
+            double Ti1 = m_days[i + 1];
 
-            double ri = m_rates[i].second;
-            double ri1 = m_rates[i + 1].second;
+            double ri = m_rates[i];
+            double ri1 = m_rates[i + 1];
 
             double delta_t = Ti1 - Ti;
             if (delta_t <= 0)
@@ -76,7 +58,34 @@ namespace minirisk
         }
     }
 
-    double CurveDiscount::df(const Date &t) const
+    void CurveDiscount::compute_grid()
+    {
+        // the same interpolation as df(), so that both modes agree to the last bit on every day
+        const size_t n_days = static_cast<size_t>(m_days.back()) + 1;
+        m_grid.resize(n_days);
+        for (size_t day = 0; day < n_days; ++day)
+        {
+            double days_from_today = static_cast<double>(day);
+            m_grid[day] = interpolate(std::max<size_t>(search(days_from_today), 1), days_from_today);
+        }
+    }
+
+    size_t CurveDiscount::search(double days_from_today) const
+    {
+        // Halve the range at each step moving its start with a conditional move,
+        // the number of iterations only depends on the number of pillars
+        const double *base = m_days.data();
+        size_t len = m_days.size();
+        while (len > 1)
+        {
+            size_t half = len / 2;
+            base += (base[half - 1] < days_from_today) ? half : 0;
+            len -= half;
+        }
+        return (base - m_days.data()) + (*base < days_from_today ? 1 : 0);
+    }
+
+    void CurveDiscount::locate(const Date &t, size_t &index, double &days_from_today) const
     {
         // Check if date is within valid range
         if (t < m_today)
@@ -84,30 +93,118 @@ namespace minirisk
             throw std::out_of_range("Cannot get discount factor for date in the past: " + t.to_string());
         }
 
-        double days_from_today = static_cast<double>(t - m_today);
+        days_from_today = static_cast<double>(t - m_today);
 
         // Use binary search to find the appropriate interval
-        auto it = std::lower_bound(m_rates.begin(), m_rates.end(), days_from_today,
-                                   [](const std::pair<double, double> &rate, double days)
-                                   {
-                                       return rate.first < days;
-                                   });
+        index = search(days_from_today);
 
-        if (it == m_rates.end())
+        if (index == m_days.size())
         {
             throw std::out_of_range("Date exceeds the maximum tenor in the curve");
         }
 
-        size_t index = std::distance(m_rates.begin(), it);
         if (index == 0)
             index = 1; // If it's the first point, use the first interval
+    }
 
-        double Ti = m_rates[index - 1].first;
-        double ri = m_rates[index - 1].second;
+    double CurveDiscount::interpolate(size_t index, double days_from_today) const
+    {
+        double Ti = m_days[index - 1];
+        double ri = m_rates[index - 1];
         double local_rate = m_local_rates[index - 1];
         double dt = days_from_today - Ti;
 
         // Compute discount factor using the specified formula
         return std::exp(-ri * Ti / 365.0 - local_rate * dt / 365.0);
     }
+
+    void CurveDiscount::check_dates(std::span<const Date> t) const
+    {
+        size_t index;
+        double days_from_today;
+        for (const Date &d : t)
+            locate(d, index, days_from_today);
+    }
+
+    double CurveDiscount::df(const Date &t) const
+    {
+        // Dense mode: dates in the past wrap around to indices beyond the grid,
+        // so that a single comparison sends all invalid dates to locate() below
+        size_t day = static_cast<size_t>(t - m_today);
+        if (day < m_grid.size())
+            return m_grid[day];
+
+        size_t index;
+        double days_from_today;
+        locate(t, index, days_from_today);
+        return interpolate(index, days_from_today);
+    }
+
+    void CurveDiscount::df_batch(std::span<const Date> t, std::span<double> df) const
+    {
+        MYASSERT(t.size() == df.size(), "Discount factors requested for " << t.size() << " dates, but space provided for " << df.size());
+
+        if (!m_grid.empty())
+        {
+            // Dense mode: gather from the grid, clamping invalid dates to its last day
+            const size_t last = m_grid.size() - 1;
+            bool invalid = false;
+            for (size_t i = 0; i < t.size(); ++i)
+            {
+                size_t day = static_cast<size_t>(t[i] - m_today);
+                invalid |= day > last;
+                df[i] = m_grid[std::min(day, last)];
+            }
+            if (invalid)
+                check_dates(t);
+            return;
+        }
+
+        // First pass: compute the exponents in the output buffer, without branching on invalid dates
+        const size_t n_pillars = m_days.size();
+        bool invalid = false;
+        for (size_t i = 0; i < t.size(); ++i)
+        {
+            double days_from_today = static_cast<double>(t[i] - m_today);
+            size_t index = search(days_from_today);
+            invalid |= (days_from_today < 0.0) | (index == n_pillars);
+            index = std::clamp<size_t>(index, 1, n_pillars - 1);
+
+            double Ti = m_days[index - 1];
+            double dt = days_from_today - Ti;
+            df[i] = -m_rates[index - 1] * Ti / 365.0 - m_local_rates[index - 1] * dt / 365.0;
+        }
+
+        // Report the first invalid date with the same error as df()
+        if (invalid)
+            check_dates(t);
+
+        // Second pass: exponentiate, vectorized
+        vec_exp(df.data(), df.data(), df.size());
+    }
+
+    df_jacobian_t CurveDiscount::df_jacobian(const Date &t) const
+    {
+        size_t index;
+        double days_from_today;
+        locate(t, index, days_from_today);
+
+        double Ti = m_days[index - 1];
+        double Ti1 = m_days[index];
+        double ri = m_rates[index - 1];
+        double local_rate = m_local_rates[index - 1];
+        double dt = days_from_today - Ti;
+
+        df_jacobian_t res;
+        res.df = std::exp(-ri * Ti / 365.0 - local_rate * dt / 365.0);
+
+        // The local rate (ri1 * Ti1 - ri * Ti) / (Ti1 - Ti) is linear in the pillar rates, hence
+        // d(exponent)/d(ri) = -Ti * (1 - dt / (Ti1 - Ti)) / 365 and d(exponent)/d(ri1) = -Ti1 * dt / (Ti1 - Ti) / 365
+        double w = dt / (Ti1 - Ti);
+        res.pillar[0] = index - 1;
+        res.pillar[1] = index;
+        res.ddf_dr[0] = -res.df * Ti * (1.0 - w) / 365.0;
+        res.ddf_dr[1] = -res.df * Ti1 * w / 365.0;
+        return res;
+    }
 } // namespace minirisk
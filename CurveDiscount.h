@@ -2,6 +2,7 @@
 
 #include "Date.h"
 #include "ICurve.h"
+#include <span>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,11 @@ namespace minirisk
 
     struct Market;
 
+    // Discount curve interpolating linearly the continuously compounded rate times the time
+    // between pillars. If the market requests a dense grid (see Market::set_df_grid), the
+    // discount factor of every day up to the last pillar is computed once when the curve is
+    // built, trading 8 bytes per day (about 29 KB for a 10 years curve) for discount factors
+    // read with a single load instead of a search and an exponential.
     struct CurveDiscount : ICurveDiscount
     {
         CurveDiscount(Market *mkt, const Date &today, const std::string &curve_name);
@@ -20,17 +26,48 @@ namespace minirisk
         // Compute the discount factor for a given date
         virtual double df(const Date &t) const override;
 
+        // Discount factors of many dates at once, see ICurveDiscount::df_batch
+        virtual void df_batch(std::span<const Date> t, std::span<double> df) const override;
+
+        // Discount factor and its derivatives with respect to the neighbouring pillar rates
+        virtual df_jacobian_t df_jacobian(const Date &t) const override;
+
+        virtual const std::vector<std::string> &pillar_names() const override { return m_pillar_names; }
+
+        virtual const std::vector<risk_factor_id_t> &pillar_ids() const override { return m_pillar_ids; }
+
     private:
-        // Convert tenor string (e.g., "1W", "1M", "2Y") to number of days
-        double convert_tenor_to_days(const std::string &tenor) const;
+        // Find the interpolation interval [index-1, index] containing date t
+        // and its distance in days from today
+        void locate(const Date &t, size_t &index, double &days_from_today) const;
+
+        // index of the first pillar not before days_from_today (m_days.size() if none),
+        // found by a binary search without branches on the data
+        size_t search(double days_from_today) const;
+
+        // discount factor of a date days_from_today in the interpolation interval [index-1, index]
+        double interpolate(size_t index, double days_from_today) const;
+
+        // throw the error of df() for the first date out of the curve range
+        void check_dates(std::span<const Date> t) const;
 
         // Precompute local rates for interpolation
         void compute_local_rates();
 
-        Date m_today;                                   // Anchor date for the curve
-        std::string m_name;                             // Curve name (e.g., "IR.USD")
-        std::vector<std::pair<double, double>> m_rates; // Pairs of (days_from_today, rate)
-        std::vector<double> m_local_rates;              // Precomputed local rates for interpolation
+        // fill m_grid with the discount factors of the days from today to the last pillar
+        void compute_grid();
+
+        Date m_today;       // Anchor date for the curve
+        std::string m_name; // Curve name (e.g., "IR.USD")
+
+        // Pillars are stored as structure of arrays, sorted by tenor
+        std::vector<double> m_days;              // Pillar distance from today in days
+        std::vector<double> m_rates;             // Pillar rates
+        std::vector<double> m_local_rates;       // Precomputed local rates for interpolation
+        std::vector<std::string> m_pillar_names; // Risk factor name of each pillar
+        std::vector<risk_factor_id_t> m_pillar_ids; // Risk factor id of each pillar
+
+        std::vector<double> m_grid; // Discount factor of each day from today in dense mode, empty otherwise
     };
 
 } // namespace minirisk
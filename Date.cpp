@@ -1,83 +1,115 @@
-#include <iomanip>
+#include <cstdint>
 #include "Date.h"
 
 namespace minirisk {
 
-struct DateInitializer : std::array<unsigned, Date::n_years>
+namespace {
+
+// Load 8 characters in a word, the first one in the lowest byte whatever the byte order
+// (compilers turn this into a single load on little endian machines)
+inline uint64_t load8(const char* p)
+{
+    uint64_t w = 0;
+    for (unsigned i = 0; i < 8; ++i)
+        w |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return w;
+}
+
+inline void store8(uint64_t w, char* p)
+{
+    for (unsigned i = 0; i < 8; ++i)
+        p[i] = static_cast<char>(w >> (8 * i));
+}
+
+inline unsigned parse_yyyymmdd(const char* text)
+{
+    const uint64_t w = load8(text);
+
+    // all bytes are digits iff their high nibble is 3 and adding 6 does not carry into it
+    const uint64_t high = 0xF0F0F0F0F0F0F0F0ull;
+    MYASSERT((((w & high) | (((w + 0x0606060606060606ull) & high) >> 4)) == 0x3333333333333333ull),
+             "Cannot parse a date in format YYYYMMDD from '" << std::string(text, Date::text_size) << "'");
+
+    // combine adjacent digits: the even bytes get the numbers YY, YY, MM and DD
+    uint64_t v = w - 0x3030303030303030ull;
+    v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FFull;
+    const unsigned y = static_cast<unsigned>(v & 0xFF) * 100 + static_cast<unsigned>((v >> 16) & 0xFF);
+    const unsigned m = static_cast<unsigned>((v >> 32) & 0xFF);
+    const unsigned d = static_cast<unsigned>((v >> 48) & 0xFF);
+
+    Date::check_valid(y, m, d);
+    return Date::compute_serial(y, m, d);
+}
+
+inline void format_yyyymmdd(unsigned serial, char* text)
+{
+    unsigned y, m, d;
+    Date::serial_to_date(serial, y, m, d);
+
+    // numbers below 100 in 16 bit lanes, split into tens (x * 103 >> 10 == x / 10 for x < 100) and units
+    const uint64_t v = (y / 100) | (static_cast<uint64_t>(y % 100) << 16) | (static_cast<uint64_t>(m) << 32) | (static_cast<uint64_t>(d) << 48);
+    const uint64_t tens = ((v * 103) >> 10) & 0x000F000F000F000Full;
+    const uint64_t units = v - tens * 10;
+    store8(tens | (units << 8) | 0x3030303030303030ull, text);
+}
+
+} // namespace
+
+unsigned Date::parse_serial(const char* text)
+{
+    return parse_yyyymmdd(text);
+}
+
+void Date::format_serial(unsigned serial, char* text)
 {
-    DateInitializer()
-    {
-        for (unsigned i = 0, s = 0, y = Date::first_year; i < size(); ++i, ++y) {
-            (*this)[i] = s;
-            s += 365 + (Date::is_leap_year(y) ? 1 : 0);
-        }
-    }
-};
-
-const std::array<unsigned, 12> Date::days_in_month = { {31,28,31,30,31,30,31,31,30,31,30,31} };
-const std::array<unsigned, 12> Date::days_ytd{ {0,31,59,90,120,151,181,212,243,273,304,334} };
-const std::array<unsigned, Date::n_years> Date::days_epoch(static_cast<const std::array<unsigned, Date::n_years>&>(DateInitializer()));
-
-/* The function checks if a given year is a leap year.
-    Leap year must be a multiple of 4, but it cannot be a multiple of 100 without also being a multiple of 400.
-*/
-bool Date::is_leap_year(unsigned year)
+    format_yyyymmdd(serial, text);
+}
+
+void Date::parse_serials(const char* texts, size_t n, unsigned* serials)
 {
-    return ((year % 4 != 0) ? false : (year % 100 != 0) ? true : (year % 400 != 0) ? false : true);
+    for (size_t i = 0; i < n; ++i)
+        serials[i] = parse_yyyymmdd(texts + i * text_size);
 }
 
-// The function pads a zero before the month or day if it has only one digit.
-std::string Date::padding_dates(unsigned month_or_day)
+void Date::format_serials(const unsigned* serials, size_t n, char* texts)
 {
-    std::ostringstream os;
-    os << std::setw(2) << std::setfill('0') << month_or_day;
-    return os.str();
+    for (size_t i = 0; i < n; ++i)
+        format_yyyymmdd(serials[i], texts + i * text_size);
 }
 
-void Date::check_valid(unsigned y, unsigned m, unsigned d)
+Date Date::from_serial(unsigned serial)
+{
+    const unsigned end = compute_serial(last_year - 1, 12, 31) + 1;
+    MYASSERT(serial < end, "The serial must be smaller than " << end << ", got " << serial);
+    Date date;
+    date.serial = serial;
+    return date;
+}
+
+void Date::invalid_date(unsigned y, unsigned m, unsigned d)
 {
     MYASSERT(y >= first_year, "The year must be no earlier than year " << first_year << ", got " << y);
     MYASSERT(y < last_year, "The year must be smaller than year " << last_year << ", got " << y);
     MYASSERT(m >= 1 && m <= 12, "The month must be a integer between 1 and 12, got " << m);
     unsigned dmax = days_in_month[m - 1] + ((m == 2 && is_leap_year(y)) ? 1 : 0);
     MYASSERT(d >= 1 && d <= dmax, "The day must be a integer between 1 and " << dmax << ", got " << d);
+    THROW("Invalid date " << y << "-" << m << "-" << d);
 }
 
-// Compute serial number (ie. days since 1-Jan-1900)
-unsigned Date::compute_serial(unsigned year, unsigned month, unsigned day) {
-    unsigned days = days_epoch[year - first_year];
-    days+= days_ytd[month -1] + ((month > 2 && is_leap_year(year)) ? 1:0 ) + (day-1);
-    return days;
-}
-
-// Convert serial number to a (year, month, day) date
+// Convert serial number to a (year, month, day) date, in constant time.
+// Civil-from-days algorithm (H. Hinnant): days are counted from 1-Mar-0000, so that the leap day
+// is the last day of the year, and split into 400-year eras of 146097 days, years of the era,
+// and months of 153 days per 5 months starting from March.
 void Date::serial_to_date(unsigned serial, unsigned& year, unsigned& month, unsigned& day) {
-    // Find year by iterating through days_epoch array
-    unsigned y = first_year;
-    while (serial >= days_epoch[y-first_year + 1]) {++y; if (y==2199) break;}
-    year = y;
-
-    // Find remaining days in year
-    unsigned days_in_year = serial - days_epoch[year - first_year];
-
-    // Adjust for leap years if date is after Feb
-    bool adjusted = false; // checks if adjustment for leap year took place
-    if (is_leap_year(year) && days_in_year>58) {days_in_year-=1; adjusted = true;}
-
-    // Find month by iterating through days_ytd
-    month = 1;
-    while(days_in_year >= days_ytd[month]) ++month;
-    
-    // Calculate Day within month
-    day = days_in_year - days_ytd[month - 1] + 1;
-    if (adjusted && days_in_year==58) day +=1; // adjusts for 29 Feb    
-}
-
-/*  The function calculates the distance between two Dates.
-    d1 > d2 is allowed, which returns the negative of d2-d1.
-*/
-long operator-(const Date& d1, const Date& d2) {
-    return static_cast<long>(d1.get_serial()) - static_cast<long>(d2.get_serial());
+    const unsigned z = serial + 693901;                                     // days since 1-Mar-0000
+    const unsigned era = z / 146097;
+    const unsigned doe = z - era * 146097;                                  // day of era, [0, 146096]
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // year of era, [0, 399]
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);           // day of year from 1-Mar, [0, 365]
+    const unsigned mp = (5 * doy + 2) / 153;                                // month from March, [0, 11]
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = yoe + era * 400 + (month <= 2 ? 1 : 0);
 }
 
 } // namespace minirisk
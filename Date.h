@@ -1,75 +1,130 @@
-#pragma once
-
-#include "Macros.h"
-#include <string>
-#include <array>
-// #include "Date.cpp"
-
-namespace minirisk {
-
-    struct Date {
-        public:
-            static const unsigned first_year = 1900;
-            static const unsigned last_year = 2200;
-            static const unsigned n_years = last_year - first_year;
-
-            // convert date to serial representation
-            static unsigned compute_serial(unsigned year, unsigned month, unsigned day);
-
-            // convert serial number back to day, month, year
-            static void serial_to_date(unsigned serial, unsigned& year, unsigned& month, unsigned& day);
-            
-        private:
-            static std::string padding_dates(unsigned);
-
-            // number of days since 1-Jan-1900
-            unsigned serial;
-
-            friend long operator-(const Date& d1, const Date& d2);
-
-            static const std::array<unsigned, 12> days_in_month;  // num of days in month M in a normal year
-            static const std::array<unsigned, 12> days_ytd;      // num of days since 1-jan to 1-M in a normal year
-            static const std::array<unsigned, n_years> days_epoch;   // num of days since 1-jan-1900 to 1-jan-yyyy (until 2200)
-
-        public:
-            // Default constructor
-            Date() : serial(compute_serial(1970, 1, 1)) {} // why is this set to 1970?
-
-            // Constructor where the input value is checked.
-            Date(unsigned year, unsigned month, unsigned day) {init(year, month, day);}
-
-            void init(unsigned year, unsigned month, unsigned day) {
-                check_valid(year, month, day);
-                serial = compute_serial(year, month, day);
-            }
-
-            static void check_valid(unsigned y, unsigned m, unsigned d);
-
-            bool operator<(const Date& d) const {return serial < d.get_serial();}
-            bool operator==(const Date& d) const {return serial == d.get_serial();}
-            bool operator>(const Date& d) const {return d < (*this);}
-
-            // Serialization format based on serial
-            unsigned get_serial() const {return serial;}
-
-            static bool is_leap_year(unsigned yr);
-
-            // Convert serial to YYYYMMDD format as a string
-            std::string to_string(bool pretty = true) const {
-
-                unsigned year, month, day;
-                serial_to_date(serial, year, month, day);
-
-                return pretty
-                    ? std::to_string(day) + "-" + std::to_string(month) + "-" + std::to_string(year)
-                    : std::to_string(year) + padding_dates(month) + padding_dates(day);
-            }
-        };
-
-    long operator-(const Date& d1, const Date& d2);
-
-    inline double time_frac(const Date& d1, const Date& d2) {
-        return static_cast<double>(d2 - d1) / 365.0;
-    }
-
-} // namespace minirisk
+#pragma once
+
+#include "Macros.h"
+#include <string>
+#include <array>
+// #include "Date.cpp"
+
+namespace minirisk {
+
+    struct Date {
+        public:
+            static const unsigned first_year = 1900;
+            static const unsigned last_year = 2200;
+            static const unsigned n_years = last_year - first_year;
+
+            // convert date to serial representation
+            static constexpr unsigned compute_serial(unsigned year, unsigned month, unsigned day) {
+                return days_epoch[year - first_year] + days_ytd[month - 1] + ((month > 2 && is_leap_year(year)) ? 1 : 0) + (day - 1);
+            }
+
+            // convert serial number back to day, month, year
+            static void serial_to_date(unsigned serial, unsigned& year, unsigned& month, unsigned& day);
+
+            // Conversions between serials and the compact text format YYYYMMDD (text_size characters,
+            // no terminator). The 8 digits are handled at once in a 64 bit word and nothing is allocated.
+            static const size_t text_size = 8;
+            static unsigned parse_serial(const char* text); // throws if the text is not a valid date
+            static void format_serial(unsigned serial, char* text);
+
+            // Bulk versions, for n dates whose texts are stored back to back
+            static void parse_serials(const char* texts, size_t n, unsigned* serials);
+            static void format_serials(const unsigned* serials, size_t n, char* texts);
+
+            // date with the given serial, which is checked
+            static Date from_serial(unsigned serial);
+
+        private:
+
+            // throw the std::invalid_argument describing why the date is invalid (not constexpr,
+            // so that an invalid date constructed at compile time is a compilation error)
+            [[noreturn]] static void invalid_date(unsigned y, unsigned m, unsigned d);
+
+            // number of days since 1-Jan-1900
+            unsigned serial;
+
+            friend constexpr long operator-(const Date& d1, const Date& d2);
+
+            // Tables computed at compile time, defined after the class
+            static const std::array<unsigned, 12> days_in_month;  // num of days in month M in a normal year
+            static const std::array<unsigned, 12> days_ytd;      // num of days since 1-jan to 1-M in a normal year
+            static const std::array<unsigned, n_years> days_epoch;   // num of days since 1-jan-1900 to 1-jan-yyyy (until 2200)
+
+            static constexpr std::array<unsigned, n_years> make_days_epoch() {
+                std::array<unsigned, n_years> days{};
+                for (unsigned i = 0, s = 0, y = first_year; i < n_years; ++i, ++y) {
+                    days[i] = s;
+                    s += 365 + (is_leap_year(y) ? 1 : 0);
+                }
+                return days;
+            }
+
+        public:
+            // Default constructor
+            constexpr Date() : serial(compute_serial(1970, 1, 1)) {} // why is this set to 1970?
+
+            // Constructor where the input value is checked.
+            // Usable in constant expressions, e.g. constexpr Date today(2017, 8, 5);
+            constexpr Date(unsigned year, unsigned month, unsigned day) : serial(0) {init(year, month, day);}
+
+            constexpr void init(unsigned year, unsigned month, unsigned day) {
+                check_valid(year, month, day);
+                serial = compute_serial(year, month, day);
+            }
+
+            static constexpr void check_valid(unsigned y, unsigned m, unsigned d) {
+                if (y < first_year || y >= last_year || m < 1 || m > 12 || d < 1 ||
+                    d > days_in_month[m - 1] + ((m == 2 && is_leap_year(y)) ? 1 : 0))
+                    invalid_date(y, m, d);
+            }
+
+            constexpr bool operator<(const Date& d) const {return serial < d.get_serial();}
+            constexpr bool operator==(const Date& d) const {return serial == d.get_serial();}
+            constexpr bool operator>(const Date& d) const {return d < (*this);}
+
+            // Serialization format based on serial
+            constexpr unsigned get_serial() const {return serial;}
+
+            /* The function checks if a given year is a leap year.
+                Leap year must be a multiple of 4, but it cannot be a multiple of 100 without also being a multiple of 400.
+            */
+            static constexpr bool is_leap_year(unsigned year) {
+                return ((year % 4 != 0) ? false : (year % 100 != 0) ? true : (year % 400 != 0) ? false : true);
+            }
+
+            // Convert serial to D-M-YYYY format (pretty) or YYYYMMDD format as a string
+            std::string to_string(bool pretty = true) const {
+                if (!pretty) {
+                    std::string text(text_size, '0'); // short enough not to allocate
+                    format_serial(serial, text.data());
+                    return text;
+                }
+
+                unsigned year, month, day;
+                serial_to_date(serial, year, month, day);
+                return std::to_string(day) + "-" + std::to_string(month) + "-" + std::to_string(year);
+            }
+        };
+
+    inline constexpr std::array<unsigned, 12> Date::days_in_month = { {31,28,31,30,31,30,31,31,30,31,30,31} };
+    inline constexpr std::array<unsigned, 12> Date::days_ytd{ {0,31,59,90,120,151,181,212,243,273,304,334} };
+    inline constexpr std::array<unsigned, Date::n_years> Date::days_epoch = Date::make_days_epoch();
+
+    /*  The function calculates the distance between two Dates.
+        d1 > d2 is allowed, which returns the negative of d2-d1.
+    */
+    constexpr long operator-(const Date& d1, const Date& d2) {
+        return static_cast<long>(d1.get_serial()) - static_cast<long>(d2.get_serial());
+    }
+
+    constexpr double time_frac(const Date& d1, const Date& d2) {
+        return static_cast<double>(d2 - d1) / 365.0;
+    }
+
+    // Date literal in the format YYYYMMDD, checked and converted at compile time,
+    // e.g. 20170805_date. An invalid date does not compile.
+    consteval Date operator""_date(unsigned long long yyyymmdd) {
+        return Date(static_cast<unsigned>(yyyymmdd / 10000), static_cast<unsigned>(yyyymmdd / 100 % 100), static_cast<unsigned>(yyyymmdd % 100));
+    }
+
+} // namespace minirisk
@@ -1,19 +1,34 @@
 #include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <iostream>
+#include <thread>
 
+#include "MarketDataFeed.h"
 #include "MarketDataServer.h"
+#include "PortfolioColumns.h"
+#include "PortfolioIncremental.h"
+#include "PortfolioStatic.h"
+#include "PortfolioStream.h"
 #include "PortfolioUtils.h"
+#include "RiskAAD.h"
+#include "RiskVaR.h"
 
 using namespace ::minirisk;
 
-void run(const string &portfolio_file, const string &risk_factors_file)
+void run(const string &portfolio_file, const string &risk_factors_file, unsigned nthreads, const string &scenario_file, const std::vector<double> &confidence_levels)
 {
+    // pool of threads for loading and pricing, only used when multi-threading is requested
+    std::unique_ptr<ThreadPool> pool;
+    if (nthreads > 0)
+        pool.reset(new ThreadPool(nthreads));
+
     // load the portfolio from file
-    portfolio_t portfolio = load_portfolio(portfolio_file);
+    portfolio_t portfolio = pool ? load_portfolio(portfolio_file, *pool) : load_portfolio(portfolio_file);
     // save and reload portfolio to implicitly test round trip serialization
     save_portfolio("portfolio.tmp", portfolio);
     portfolio.clear();
-    portfolio = load_portfolio("portfolio.tmp");
+    portfolio = pool ? load_portfolio("portfolio.tmp", *pool) : load_portfolio("portfolio.tmp");
 
     // display portfolio
     print_portfolio(portfolio);
@@ -25,13 +40,13 @@ void run(const string &portfolio_file, const string &risk_factors_file)
     std::shared_ptr<const MarketDataServer> mds(new MarketDataServer(risk_factors_file));
 
     // Init market object
-    Date today(2017, 8, 5);
+    constexpr Date today = 20170805_date;
     Market mkt(mds, today);
 
     // Price all products. Market objects are automatically constructed on demand,
     // fetching data as needed from the market data server.
     {
-        auto prices = compute_prices(pricers, mkt);
+        auto prices = pool ? compute_prices(pricers, mkt, *pool) : compute_prices(pricers, mkt);
 
         // Calculate total and identify failed trades
         double total = 0.0;
@@ -64,6 +79,17 @@ void run(const string &portfolio_file, const string &risk_factors_file)
 
         // Display PV
         print_price_vector("PV", prices);
+
+        // Reprice the portfolio stored as columns with the batch pricer, which should give the same total
+        portfolio_columns_t columns;
+        load_portfolio("portfolio.tmp", columns);
+        std::cout << "Total PV from the columnar pricer: " << portfolio_total(compute_prices(columns, mkt)).first << "\n";
+
+        // and with the pricers dispatched at compile time
+        static_portfolio_t static_portfolio;
+        load_portfolio("portfolio.tmp", static_portfolio);
+        auto static_prices = pool ? compute_prices(static_portfolio, mkt, *pool) : compute_prices(static_portfolio, mkt);
+        std::cout << "Total PV from the static pricer: " << portfolio_total(static_prices).first << "\n\n";
     }
 
     // disconnect the market (no more fetching from the market data server allowed)
@@ -80,7 +106,7 @@ void run(const string &portfolio_file, const string &risk_factors_file)
 
     {
         // Compute PV01 bucketed (sensitivity with respect to interest rate dV/dr)
-        std::vector<std::pair<string, portfolio_values_t>> pv01_bucketed = compute_pv01_bucketed(pricers, mkt);
+        std::vector<std::pair<string, portfolio_values_t>> pv01_bucketed = pool ? compute_pv01_bucketed(pricers, mkt, *pool) : compute_pv01_bucketed(pricers, mkt);
 
         // Display PV01 per currency for bucketed
         for (const auto &g : pv01_bucketed)
@@ -88,8 +114,21 @@ void run(const string &portfolio_file, const string &risk_factors_file)
             print_price_vector("PV01 Bucketed " + g.first, g.second);
         }
 
+        // Validate the adjoint PV01 against the bucketed finite differences
+        std::vector<std::pair<string, portfolio_values_t>> pv01_aad = compute_pv01_aad(portfolio, mkt);
+        std::cout << "PV01 AAD vs bucketed, max abs difference:\n";
+        for (size_t k = 0; k < pv01_aad.size(); ++k)
+        {
+            double maxdiff = 0.0;
+            for (size_t i = 0; i < portfolio.size(); ++i)
+                if (!std::isnan(pv01_aad[k].second[i].first) && !std::isnan(pv01_bucketed[k].second[i].first))
+                    maxdiff = std::max(maxdiff, std::abs(pv01_aad[k].second[i].first - pv01_bucketed[k].second[i].first));
+            std::cout << format_label(pv01_aad[k].first) << maxdiff << "\n";
+        }
+        std::cout << "\n";
+
         // Compute PV01 parallel
-        std::vector<std::pair<string, portfolio_values_t>> pv01_parallel = compute_pv01_parallel(pricers, mkt);
+        std::vector<std::pair<string, portfolio_values_t>> pv01_parallel = pool ? compute_pv01_parallel(pricers, mkt, *pool) : compute_pv01_parallel(pricers, mkt);
 
         // Display PV01 per currency for parallel
         for (const auto &g : pv01_parallel)
@@ -97,6 +136,88 @@ void run(const string &portfolio_file, const string &risk_factors_file)
             print_price_vector("PV01 Parallel " + g.first, g.second);
         }
     }
+
+    // Historical simulation VaR and expected shortfall, if scenarios are provided
+    if (!scenario_file.empty())
+    {
+        var_result_t var = pool
+                               ? compute_historical_var(pricers, mkt, scenario_file, confidence_levels, *pool)
+                               : compute_historical_var(pricers, mkt, scenario_file, confidence_levels);
+
+        std::cout << "\nHistorical simulation over " << var.pnl.size() << " scenarios\n";
+        std::cout << format_label("Base PV") << var.base_pv << "\n";
+        if (var.n_errors > 0)
+            std::cout << "Trades left out, failing to price: " << var.n_errors << "\n";
+        if (var.n_scenario_errors > 0)
+            std::cout << "Scenario repricings failed: " << var.n_scenario_errors << "\n";
+        for (const auto &l : var.levels)
+        {
+            std::ostringstream level;
+            level << 100.0 * l.confidence << "%";
+            std::cout << format_label("VaR " + level.str()) << l.var << "\n";
+            std::cout << format_label("ES " + level.str()) << l.es << "\n";
+        }
+    }
+}
+
+// Price the portfolio chunk by chunk while reading it, without holding it all in memory
+void run_streaming(const string &portfolio_file, const string &risk_factors_file, unsigned nthreads, size_t chunk_size)
+{
+    // initialize market data server
+    std::shared_ptr<const MarketDataServer> mds(new MarketDataServer(risk_factors_file));
+
+    // Init market object
+    constexpr Date today = 20170805_date;
+    Market mkt(mds, today);
+
+    std::unique_ptr<ThreadPool> pool;
+    if (nthreads > 0)
+        pool.reset(new ThreadPool(nthreads));
+
+    portfolio_summary_t summary = pool
+                                      ? price_portfolio_stream(portfolio_file, mkt, chunk_size, *pool)
+                                      : price_portfolio_stream(portfolio_file, mkt, chunk_size);
+
+    std::cout << "Number of trades: " << summary.n_trades << "\n";
+    std::cout << "Total PV of successfully priced trades: " << summary.total << "\n";
+    if (summary.n_errors > 0)
+    {
+        std::cout << "Number of trades that failed to price: " << summary.n_errors << "\n";
+        for (const auto &ft : summary.errors)
+            std::cout << "Trade index " << ft.first << " failed to price with error: " << ft.second << "\n";
+        if (summary.errors.size() < summary.n_errors)
+            std::cout << "(" << summary.n_errors - summary.errors.size() << " more errors not shown)\n";
+    }
+}
+
+// Revalue the portfolio repeatedly while a simulated feed publishes market data updates,
+// repricing at each revaluation only the trades depending on the risk factors which moved
+void run_live(const string &portfolio_file, const string &risk_factors_file, unsigned nthreads, unsigned n_revaluations)
+{
+    std::unique_ptr<ThreadPool> pool;
+    if (nthreads > 0)
+        pool.reset(new ThreadPool(nthreads));
+
+    portfolio_t portfolio = pool ? load_portfolio(portfolio_file, *pool) : load_portfolio(portfolio_file);
+    std::vector<ppricer_t> pricers(get_pricers(portfolio));
+
+    std::shared_ptr<MarketDataServer> mds(new MarketDataServer(risk_factors_file));
+    constexpr Date today = 20170805_date;
+    Market mkt(mds, today);
+
+    // every 50 ms, 5 risk factors move by about 1%
+    const std::chrono::milliseconds interval(50);
+    market_data_feed_t feed(mds, simulated_tick_source(mds, 5, 0.01, 1234), interval);
+
+    std::unique_ptr<incremental_pricer_t> prices(pool ? new incremental_pricer_t(pricers, mkt, *pool) : new incremental_pricer_t(pricers, mkt));
+    for (unsigned i = 0; i < n_revaluations; ++i)
+    {
+        std::this_thread::sleep_for(interval);
+        size_t repriced = prices->refresh();
+        std::cout << "Snapshot " << mkt.snapshot_version() << ", " << repriced << " trades repriced, "
+                  << "total PV of successfully priced trades: " << prices->total() << "\n";
+    }
+    feed.stop();
 }
 
 void usage()
@@ -104,33 +225,73 @@ void usage()
     std::cerr
         << "Invalid command line arguments\n"
         << "Example:\n"
-        << "DemoRisk -p portfolio.txt -f risk_factors.txt\n";
+        << "DemoRisk -p portfolio.txt -f risk_factors.txt [-t num_threads] [-s chunk_size] [-v scenarios.txt [-c 0.99,0.975]] [-l num_revaluations]\n"
+        << "With -s the portfolio is only priced, streaming it in chunks of chunk_size trades\n"
+        << "With -v the historical simulation VaR and ES are computed at the confidence levels given by -c\n"
+        << "With -l the portfolio is revalued num_revaluations times while a simulated feed updates the market\n";
     std::exit(-1);
 }
 
+// parse the value of a numeric option: a whole string of decimal digits, no larger than max
+size_t parse_count(const string &key, const string &value, size_t max)
+{
+    size_t n = 0;
+    const char *end = value.data() + value.size();
+    auto res = std::from_chars(value.data(), end, n);
+    MYASSERT(res.ec == std::errc() && res.ptr == end && n <= max, "Invalid value " << value << " for " << key << ", expected an integer from 0 to " << max);
+    return n;
+}
+
 int main(int argc, const char **argv)
 {
     // parse command line arguments
     string portfolio, riskfactors;
+    unsigned nthreads = 0;
+    size_t chunk_size = 0;
+    string scenarios;
+    unsigned n_revaluations = 0;
+    std::vector<double> confidence_levels{0.99, 0.975};
     if (argc % 2 == 0)
         usage();
-    for (int i = 1; i < argc; i += 2)
-    {
-        string key(argv[i]);
-        string value(argv[i + 1]);
-        if (key == "-p")
-            portfolio = value;
-        else if (key == "-f")
-            riskfactors = value;
-        else
-            usage();
-    }
-    if (portfolio == "" || riskfactors == "")
-        usage();
 
     try
     {
-        run(portfolio, riskfactors);
+        for (int i = 1; i < argc; i += 2)
+        {
+            string key(argv[i]);
+            string value(argv[i + 1]);
+            if (key == "-p")
+                portfolio = value;
+            else if (key == "-f")
+                riskfactors = value;
+            else if (key == "-t")
+                nthreads = static_cast<unsigned>(parse_count(key, value, 1024));
+            else if (key == "-s")
+                chunk_size = parse_count(key, value, size_t(1) << 30);
+            else if (key == "-l")
+                n_revaluations = static_cast<unsigned>(parse_count(key, value, 1000000));
+            else if (key == "-v")
+                scenarios = value;
+            else if (key == "-c")
+            {
+                confidence_levels.clear();
+                std::istringstream is(value);
+                string level;
+                while (std::getline(is, level, ','))
+                    confidence_levels.push_back(std::atof(level.c_str()));
+            }
+            else
+                usage();
+        }
+        if (portfolio == "" || riskfactors == "")
+            usage();
+
+        if (n_revaluations > 0)
+            run_live(portfolio, riskfactors, nthreads, n_revaluations);
+        else if (chunk_size > 0)
+            run_streaming(portfolio, riskfactors, nthreads, chunk_size);
+        else
+            run(portfolio, riskfactors, nthreads, scenarios, confidence_levels);
         return 0; // report success to the caller
     }
     catch (const std::exception &e)
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <memory>
+#include <span>
 #include <string>
 
+#include <vector>
+
 #include "IObject.h"
 #include "Date.h"
+#include "RiskFactors.h"
 
 using std::string;
 
@@ -26,10 +30,34 @@ struct ICurveDiscount;
 typedef std::shared_ptr<const ICurve> ptr_curve_t;
 typedef std::shared_ptr<const ICurveDiscount> ptr_disc_curve_t;
 
+// A discount factor only depends on the rates of the two pillars delimiting
+// its interpolation interval, so its gradient has at most two non-zero entries
+struct df_jacobian_t
+{
+    double df;
+    size_t pillar[2];   // indices of the pillars in ICurveDiscount::pillar_names()
+    double ddf_dr[2];   // derivative of df with respect to the rate of each pillar
+};
+
 struct ICurveDiscount : ICurve
 {
     // compute the discount factor for date t
     virtual double df(const Date& t) const = 0;
+
+    // compute the discount factors for all dates in t, storing them in the corresponding
+    // elements of df (same size as t). Throws as df(t[i]) would for the first date which is
+    // not valid. The results are those of df to the last bit, except when the exponential
+    // is vectorized (builds with AVX2, see vec_exp) where they are within 2 ulps of them.
+    virtual void df_batch(std::span<const Date> t, std::span<double> df) const = 0;
+
+    // discount factor for date t together with its analytic sensitivity to the pillar rates
+    virtual df_jacobian_t df_jacobian(const Date& t) const = 0;
+
+    // names of the risk factors the curve is built from
+    virtual const std::vector<string>& pillar_names() const = 0;
+
+    // ids of the same risk factors in the market the curve was built from
+    virtual const std::vector<risk_factor_id_t>& pillar_ids() const = 0;
 };
 
 struct ICurveFXForward : ICurve
@@ -2,37 +2,293 @@
 #include "CurveDiscount.h"
 
 #include <algorithm>
+#include <array>
 #include <limits>
 #include <vector>
 
 namespace minirisk
 {
 
+    namespace
+    {
+        // risk factors read while building a curve of a market
+        struct read_log_t
+        {
+            const Market *m_market;
+            std::vector<risk_factor_id_t> m_ids;
+        };
+
+        // log of the curve being built by this thread, if any
+        thread_local read_log_t *tl_read_log = nullptr;
+
+        // source of the versions of the curve maps, 0 is never used
+        std::atomic<uint64_t> g_curves_version{0};
+
+        // true if the two sorted lists have an element in common
+        bool intersects(const std::vector<risk_factor_id_t> &a, const std::vector<risk_factor_id_t> &b)
+        {
+            auto i = a.begin();
+            auto j = b.begin();
+            while (i != a.end() && j != b.end())
+            {
+                if (*i < *j)
+                    ++i;
+                else if (*j < *i)
+                    ++j;
+                else
+                    return true;
+            }
+            return false;
+        }
+    }
+
+    void Market::log_read(risk_factor_id_t id) const
+    {
+        if (tl_read_log && tl_read_log->m_market == this)
+            tl_read_log->m_ids.push_back(id);
+    }
+
+    std::vector<risk_factor_id_t> Market::record_reads(const std::function<void()> &f)
+    {
+        // the log of an enclosing recording is restored afterwards, nested logs are independent
+        read_log_t log{this, {}};
+        read_log_t *outer = tl_read_log;
+        tl_read_log = &log;
+        try
+        {
+            f();
+        }
+        catch (...)
+        {
+            tl_read_log = outer;
+            throw;
+        }
+        tl_read_log = outer;
+
+        std::sort(log.m_ids.begin(), log.m_ids.end());
+        log.m_ids.erase(std::unique(log.m_ids.begin(), log.m_ids.end()), log.m_ids.end());
+        return std::move(log.m_ids);
+    }
+
+    Market::Market(const std::shared_ptr<const MarketDataServer> &mds, const Date &today)
+        : m_today(today), m_mds(mds), m_df_grid(false), m_base(nullptr)
+    {
+        publish_curves(std::make_shared<const curve_map_t>());
+        MYASSERT(mds, "A market requires a market data server");
+        m_symbols = mds->symbols();
+        m_snapshot = mds->snapshot();
+        m_values = std::vector<std::atomic<double>>(m_symbols->size());
+        m_loaded = std::vector<std::atomic<bool>>(m_symbols->size());
+    }
+
+    Market::Market(const Market &other)
+        : m_base(other.m_base), m_symbols(other.m_symbols), m_values(other.m_values.size()), m_loaded(other.m_loaded.size())
+    {
+        std::lock_guard<std::mutex> lock(other.m_mutex);
+        m_today = other.m_today;
+        m_mds = other.m_mds;
+        m_snapshot = other.m_snapshot;
+        m_df_grid.store(other.m_df_grid.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_overrides.store(other.m_overrides.load());
+
+        for (size_t i = 0; i < m_values.size(); ++i)
+        {
+            m_values[i].store(other.m_values[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_loaded[i].store(other.m_loaded[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        // slots are not shared, otherwise curves built by one market would leak into the other
+        auto curves = std::make_shared<curve_map_t>();
+        auto other_curves = other.m_curves.load();
+        for (const auto &c : *other_curves)
+        {
+            if (!c.second->m_ready.load())
+                continue;
+            auto slot = std::make_shared<curve_slot_t>();
+            slot->m_curve = c.second->m_curve;
+            slot->m_dependencies = c.second->m_dependencies;
+            slot->m_ready.store(true);
+            curves->emplace(c.first, slot);
+        }
+        publish_curves(curves);
+    }
+
+    Market::Market(Market &base, const vec_risk_factor_t &overrides)
+        : m_base(&base), m_overrides(std::make_shared<const overrides_t>()), m_symbols(base.m_symbols)
+    {
+        publish_curves(std::make_shared<const curve_map_t>());
+        {
+            std::lock_guard<std::mutex> lock(base.m_mutex);
+            m_today = base.m_today;
+            m_mds = base.m_mds;
+            m_snapshot = base.m_snapshot;
+            m_df_grid.store(base.m_df_grid.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        set_risk_factors(overrides);
+    }
+
+    void Market::publish_curves(std::shared_ptr<const curve_map_t> curves)
+    {
+        m_curves.store(std::move(curves));
+        m_curves_version.store(++g_curves_version, std::memory_order_release);
+    }
+
+    const Market::curve_map_t &Market::curve_map() const
+    {
+        // A few entries, so that a thread alternating between an overlay and its base, or
+        // between scenarios, keeps hitting. The references held by a thread keep old maps
+        // alive until it reads other ones, which is harmless as they are never modified.
+        struct entry_t
+        {
+            uint64_t version = 0;
+            std::shared_ptr<const curve_map_t> map;
+        };
+        thread_local std::array<entry_t, 4> cache;
+
+        const uint64_t version = m_curves_version.load(std::memory_order_acquire);
+        entry_t &entry = cache[version % cache.size()];
+        if (entry.version != version)
+        {
+            // the map loaded is the one of this version or a newer one, both are valid
+            entry.map = m_curves.load();
+            entry.version = version;
+        }
+        return *entry.map;
+    }
+
+    Market::curve_slot_t *Market::curve_slot(const string &name)
+    {
+        const curve_map_t &curves = curve_map();
+        auto iter = curves.find(name);
+        if (iter != curves.end())
+            return iter->second.get();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto current = m_curves.load(); // reload, another thread may have inserted it meanwhile
+        iter = current->find(name);
+        if (iter != current->end())
+            return iter->second.get();
+        auto updated = std::make_shared<curve_map_t>(*current);
+        curve_slot_t *slot = updated->emplace(name, std::make_shared<curve_slot_t>()).first->second.get();
+        publish_curves(std::move(updated));
+        return slot;
+    }
+
+    template <typename T>
+    Market::curve_slot_t *Market::ready_slot(const string &name)
+    {
+        curve_slot_t *slot = curve_slot(name);
+        if (!slot->m_ready.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(slot->m_mutex);
+
+            // an overlay reuses the curve of its base, unless built from an overlaid risk factor
+            if (m_base && !slot->m_ready.load(std::memory_order_relaxed))
+            {
+                curve_slot_t *base_slot = m_base->ready_slot<T>(name);
+                std::vector<risk_factor_id_t> overlaid;
+                for (const auto &o : *m_overrides.load())
+                    overlaid.push_back(o.first);
+                if (!intersects(base_slot->m_dependencies, overlaid))
+                {
+                    slot->m_curve = base_slot->m_curve;
+                    slot->m_dependencies = base_slot->m_dependencies;
+                    slot->m_ready.store(true, std::memory_order_release);
+                }
+            }
+
+            if (!slot->m_ready.load(std::memory_order_relaxed))
+            {
+                // if the construction throws the slot stays empty and the next request tries again
+                slot->m_dependencies = record_reads([&]()
+                                                    { slot->m_curve.reset(new T(this, m_today, name)); });
+                slot->m_ready.store(true, std::memory_order_release);
+            }
+        }
+
+        // whatever is built or priced from this curve depends on the same risk factors
+        if (tl_read_log && tl_read_log->m_market == this)
+            tl_read_log->m_ids.insert(tl_read_log->m_ids.end(), slot->m_dependencies.begin(), slot->m_dependencies.end());
+
+        return slot;
+    }
+
     template <typename I, typename T>
-    std::shared_ptr<const I> Market::get_curve(const string &name)
+    const I &Market::get_curve(const string &name)
     {
-        ptr_curve_t &curve_ptr = m_curves[name];
-        if (!curve_ptr.get())
-            curve_ptr.reset(new T(this, m_today, name));
-        std::shared_ptr<const I> res = std::dynamic_pointer_cast<const I>(curve_ptr);
+        const I *res = dynamic_cast<const I *>(ready_slot<T>(name)->m_curve.get());
         MYASSERT(res, "Cannot cast object with name " << name << " to type " << typeid(I).name());
-        return res;
+        return *res;
     }
 
     const ptr_disc_curve_t Market::get_discount_curve(const string &name)
+    {
+        // the curve is owned by its slot, shared with the caller
+        const ICurveDiscount &curve = get_curve<ICurveDiscount, CurveDiscount>(name);
+        return ptr_disc_curve_t(curve_slot(name)->m_curve, &curve);
+    }
+
+    const ICurveDiscount &Market::discount_curve(const string &name)
     {
         return get_curve<ICurveDiscount, CurveDiscount>(name);
     }
 
     double Market::from_mds(const string &objtype, const string &name)
     {
-        auto ins = m_risk_factors.emplace(name, std::numeric_limits<double>::quiet_NaN());
-        if (ins.second)
-        { // just inserted, need to be populated
-            MYASSERT(m_mds, "Cannot fetch " << objtype << " " << name << " because the market data server has been disconnnected");
-            ins.first->second = m_mds->get(name);
+        risk_factor_id_t id = m_symbols->find(name);
+        if (id != invalid_risk_factor_id)
+            return from_mds(objtype, id);
+
+        // not known by the market data server: report the error it gives
+        std::lock_guard<std::mutex> lock(m_mutex);
+        MYASSERT(m_mds, "Cannot fetch " << objtype << " " << name << " because the market data server has been disconnnected");
+        return m_mds->get(name);
+    }
+
+    bool Market::lookup(risk_factor_id_t id, double &value) const
+    {
+        if (m_base)
+        {
+            auto overrides = m_overrides.load();
+            auto iter = std::lower_bound(overrides->begin(), overrides->end(), id, [](const auto &o, risk_factor_id_t i)
+                                         { return o.first < i; });
+            if (iter != overrides->end() && iter->first == id)
+            {
+                value = iter->second;
+                return true;
+            }
+            return m_base->lookup(id, value);
         }
-        return ins.first->second;
+        if (!m_loaded[id].load(std::memory_order_acquire))
+            return false;
+        value = m_values[id].load(std::memory_order_relaxed);
+        return true;
+    }
+
+    double Market::from_mds(const string &objtype, risk_factor_id_t id)
+    {
+        log_read(id);
+        double value;
+        if (lookup(id, value))
+            return value;
+
+        if (m_base)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                MYASSERT(m_mds, "Cannot fetch " << objtype << " " << m_symbols->name(id) << " because the market data server has been disconnnected");
+            }
+            return m_base->from_mds(objtype, id);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_loaded[id].load(std::memory_order_relaxed)) // another thread may have fetched it meanwhile
+            return m_values[id].load(std::memory_order_relaxed);
+        MYASSERT(m_mds, "Cannot fetch " << objtype << " " << m_symbols->name(id) << " because the market data server has been disconnnected");
+        value = m_snapshot->values[id];
+        m_values[id].store(value, std::memory_order_relaxed);
+        m_loaded[id].store(true, std::memory_order_release);
+        return value;
     }
 
     const double Market::get_yield(const string &ccyname)
@@ -48,29 +304,129 @@ namespace minirisk
 
     void Market::set_risk_factors(const vec_risk_factor_t &risk_factors)
     {
-        clear();
+        overrides_t values;
         for (const auto &d : risk_factors)
         {
-            auto i = m_risk_factors.find(d.first);
-            MYASSERT((i != m_risk_factors.end()), "Risk factor not found " << d.first);
-            i->second = d.second;
+            risk_factor_id_t id = m_symbols->find(d.first);
+            double old_value;
+            MYASSERT((id != invalid_risk_factor_id && lookup(id, old_value)), "Risk factor not found " << d.first);
+            values.emplace_back(id, d.second);
         }
+        modify_risk_factors(std::move(values));
+    }
+
+    void Market::modify_risk_factors(overrides_t &&values)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<risk_factor_id_t> changed;
+        if (m_base)
+        {
+            // publish a modified copy of the (few) overlaid values
+            auto updated = std::make_shared<overrides_t>(*m_overrides.load());
+            for (const auto &v : values)
+            {
+                auto iter = std::lower_bound(updated->begin(), updated->end(), v.first, [](const auto &o, risk_factor_id_t i)
+                                             { return o.first < i; });
+                if (iter != updated->end() && iter->first == v.first)
+                    iter->second = v.second;
+                else
+                    updated->insert(iter, v);
+                changed.push_back(v.first);
+            }
+            m_overrides.store(updated);
+        }
+        else
+        {
+            for (const auto &v : values)
+            {
+                m_values[v.first].store(v.second, std::memory_order_relaxed);
+                changed.push_back(v.first);
+            }
+        }
+        invalidate_curves(std::move(changed));
+    }
+
+    void Market::invalidate_curves(std::vector<risk_factor_id_t> &&changed)
+    {
+        std::sort(changed.begin(), changed.end());
+
+        // Curves still being built may have read the old values, so they are dropped as well.
+        // A builder in progress completes on its own slot, which is no more reachable.
+        auto curves = m_curves.load();
+        auto updated = std::make_shared<curve_map_t>();
+        for (const auto &c : *curves)
+            if (c.second->m_ready.load(std::memory_order_acquire) && !intersects(c.second->m_dependencies, changed))
+                updated->emplace(c);
+        if (updated->size() != curves->size())
+            publish_curves(std::move(updated));
+    }
+
+    std::vector<risk_factor_id_t> Market::curve_dependencies(const string &name) const
+    {
+        auto curves = m_curves.load();
+        auto iter = curves->find(name);
+        if (iter == curves->end() || !iter->second->m_ready.load(std::memory_order_acquire))
+            return std::vector<risk_factor_id_t>();
+        return iter->second->m_dependencies;
     }
 
     Market::vec_risk_factor_t Market::get_risk_factors(const std::string &expr) const
     {
         vec_risk_factor_t result;
         std::regex r(expr);
-        for (const auto &d : m_risk_factors)
-            if (std::regex_match(d.first, r))
-                result.push_back(d);
+        double value;
+        for (risk_factor_id_t id = 0; id < m_symbols->size(); ++id)
+            if (lookup(id, value) && std::regex_match(m_symbols->name(id), r))
+            {
+                log_read(id);
+                result.emplace_back(m_symbols->name(id), value);
+            }
+        return result;
+    }
+
+    Market::vec_risk_factor_t Market::fetch_risk_factors(const std::string &expr)
+    {
+        std::shared_ptr<const MarketDataServer> mds;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            mds = m_mds;
+        }
+        if (mds)
+            for (const auto &d : mds->match(expr))
+                from_mds("risk factor", d.first);
+        return get_risk_factors(expr);
+    }
+
+    Market::vec_risk_factor_t Market::get_risk_factors(const std::vector<risk_factor_id_t> &ids) const
+    {
+        vec_risk_factor_t result;
+        double value;
+        for (risk_factor_id_t id : ids)
+            if (lookup(id, value))
+            {
+                log_read(id);
+                result.emplace_back(m_symbols->name(id), value);
+            }
         return result;
     }
 
+    Market::vec_risk_factor_t Market::fetch_risk_factors(const std::vector<risk_factor_id_t> &ids)
+    {
+        bool connected;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            connected = m_mds != nullptr;
+        }
+        if (connected)
+            for (risk_factor_id_t id : ids)
+                get_risk_factor(id);
+        return get_risk_factors(ids);
+    }
+
     std::vector<std::string> Market::get_all_yield_curve_tenors() const
     {
         std::vector<std::string> tenors;
-        auto risk_factors = get_risk_factors(ir_rate_prefix + ".*");
+        auto risk_factors = get_risk_factors(m_symbols->ir_pillars());
 
         for (const auto &rf : risk_factors)
         {
@@ -80,27 +436,53 @@ namespace minirisk
         return tenors;
     }
 
-    void Market::bump_yield_curve(const string &ccy, double bump_size)
+    std::vector<risk_factor_id_t> Market::refresh()
     {
-        string pattern = ir_rate_prefix + ".*\\." + ccy;
-        auto yield_curve_points = get_risk_factors(pattern);
-
-        for (auto &point : yield_curve_points)
+        MYASSERT(!m_base, "An overlay market cannot be refreshed, its base can");
+        overrides_t values;
         {
-            point.second += bump_size; // apply bump
-            m_risk_factors[point.first] = point.second;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            MYASSERT(m_mds, "Cannot refresh the market because the market data server has been disconnnected");
+            auto latest = m_mds->snapshot();
+            if (latest == m_snapshot)
+                return {};
+            for (risk_factor_id_t id = 0; id < m_symbols->size(); ++id)
+                if (m_loaded[id].load(std::memory_order_relaxed) && m_values[id].load(std::memory_order_relaxed) != latest->values[id])
+                    values.emplace_back(id, latest->values[id]);
+            m_snapshot = latest; // risk factors not fetched yet will come from the new snapshot
         }
+
+        std::vector<risk_factor_id_t> changed(values.size());
+        std::transform(values.begin(), values.end(), changed.begin(), [](const auto &v)
+                       { return v.first; });
+        modify_risk_factors(std::move(values));
+        return changed;
     }
 
-    void Market::bump_all_yield_curves(double bump_size)
+    uint64_t Market::snapshot_version() const
     {
-        auto yield_curve_points = get_risk_factors(ir_rate_prefix + ".*");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_snapshot->version;
+    }
 
-        for (auto &point : yield_curve_points)
-        {
-            point.second += bump_size; // apply bump
-            m_risk_factors[point.first] = point.second;
-        }
+    void Market::bump_risk_factors(const std::vector<risk_factor_id_t> &ids, double bump_size)
+    {
+        overrides_t values;
+        double value;
+        for (risk_factor_id_t id : ids)
+            if (lookup(id, value))
+                values.emplace_back(id, value + bump_size); // apply bump
+        modify_risk_factors(std::move(values));
+    }
+
+    void Market::bump_yield_curve(const string &ccy, double bump_size)
+    {
+        bump_risk_factors(m_symbols->ir_pillars(ccy), bump_size);
+    }
+
+    void Market::bump_all_yield_curves(double bump_size)
+    {
+        bump_risk_factors(m_symbols->ir_pillars(), bump_size);
     }
 
 } // namespace minirisk
@@ -4,6 +4,11 @@
 #include "ICurve.h"
 #include "IObject.h"
 #include "MarketDataServer.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <vector>
 
@@ -13,52 +18,122 @@ namespace minirisk
     struct Market : IObject
     {
     private:
-        // NOTE: this function is not thread safe
+        // Thread safe: curves already built are returned without locking (see curve_map),
+        // a missing curve is built exactly once even if requested by several threads at the same time.
         template <typename I, typename T>
-        std::shared_ptr<const I> get_curve(const string &name);
+        const I &get_curve(const string &name);
 
+        // Thread safe: data points already fetched are returned without locking.
         double from_mds(const string &objtype, const string &name);
+        double from_mds(const string &objtype, risk_factor_id_t id);
 
     public:
         typedef std::pair<string, double> risk_factor_t;
         typedef std::vector<std::pair<string, double>> vec_risk_factor_t;
 
-        Market(const std::shared_ptr<const MarketDataServer> &mds, const Date &today)
-            : m_today(today), m_mds(mds)
-        {
-        }
+        Market(const std::shared_ptr<const MarketDataServer> &mds, const Date &today);
+
+        // the copy shares the curves already built, which are never modified in place,
+        // and has its own copy of the data points
+        Market(const Market &other);
+
+        // Scenario market overlaying new values of some risk factors on base, which must outlive it.
+        // Other risk factors are read from base, and the curves of base not built from any of the
+        // overlaid risk factors are reused. Creating an overlay costs O(overlaid risk factors),
+        // independently of the size of base. The risk factors must have been fetched by base.
+        Market(Market &base, const vec_risk_factor_t &overrides);
 
         virtual Date today() const { return m_today; }
 
         // get an object of type ICurveDisocunt
         const ptr_disc_curve_t get_discount_curve(const string &name);
 
+        // Same as above without taking a reference to the curve, for the pricing hot path.
+        // The curve stays valid until the market is modified (clear, set_risk_factors, refresh...).
+        const ICurveDiscount &discount_curve(const string &name);
+
         // yield rate for currency name
         const double get_yield(const string &name);
 
         // fx exchange rate to convert 1 unit of ccy1 into USD
         const double get_fx_spot(const string &ccy);
 
+        // Id of a risk factor name (e.g. "IR.1Y.USD", "FX.SPOT.EUR"), or invalid_risk_factor_id if
+        // the market data server does not know it. Pricers and curves can resolve names once
+        // and then read values by id, without building and looking up strings.
+        risk_factor_id_t risk_factor_id(const string &name) const { return m_symbols->find(name); }
+
+        // name of the risk factor with the given id
+        const string &risk_factor_name(risk_factor_id_t id) const { return m_symbols->name(id); }
+
+        // all the risk factors the market can fetch, with their structured keys and indices
+        const risk_factor_table_t &symbols() const { return *m_symbols; }
+
+        // value of a risk factor, fetched from the market data server if needed
+        double get_risk_factor(risk_factor_id_t id) { return from_mds("risk factor", id); }
+
+        // Risk factors are fetched from the snapshot of the market data server taken when the market
+        // was created, so all the prices computed with a market are consistent even if the server
+        // publishes updates meanwhile. refresh moves to the latest snapshot: the risk factors already
+        // fetched take their new values and only the curves built from those which changed are
+        // destroyed. Returns the ids of the changed risk factors, sorted. Must not be called on
+        // an overlay, nor while the market is being used for pricing.
+        std::vector<risk_factor_id_t> refresh();
+
+        // version of the market data server snapshot in use
+        uint64_t snapshot_version() const;
+
         // after the market has been disconnected, it is no more possible to fetch
         // new data points from the market data server
         void disconnect()
         {
+            std::lock_guard<std::mutex> lock(m_mutex);
             m_mds.reset();
         }
 
         // returns risk factors matching a regular expression
         vec_risk_factor_t get_risk_factors(const std::string &expr) const;
 
+        // returns risk factors matching a regular expression, first fetching from the
+        // market data server all those which are not yet in the market (if still connected)
+        vec_risk_factor_t fetch_risk_factors(const std::string &expr);
+
+        // Same as above for a list of ids, e.g. symbols().ir_pillars(ccy), without regular
+        // expression matching. The result follows the order of the ids.
+        vec_risk_factor_t get_risk_factors(const std::vector<risk_factor_id_t> &ids) const;
+        vec_risk_factor_t fetch_risk_factors(const std::vector<risk_factor_id_t> &ids);
+
+        // Build the discount curves with a dense table of the discount factors of every day up to
+        // their last pillar, so that a discount factor is a single load (see CurveDiscount).
+        // Off by default. Changing it destroys the curves built so far.
+        void set_df_grid(bool on)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_df_grid.store(on, std::memory_order_relaxed);
+            publish_curves(std::make_shared<const curve_map_t>());
+        }
+
+        bool df_grid() const { return m_df_grid.load(std::memory_order_relaxed); }
+
         // clear all market curves except for the data points
         void clear()
         {
-            std::for_each(m_curves.begin(), m_curves.end(), [](auto &p)
-                          { p.second.reset(); });
+            std::lock_guard<std::mutex> lock(m_mutex);
+            publish_curves(std::make_shared<const curve_map_t>());
         }
 
-        // destroy all existing objects and modify a selected number of data points
+        // Modify a selected number of data points. Only the curves built from them are
+        // destroyed (and rebuilt on demand), the others are kept.
         void set_risk_factors(const vec_risk_factor_t &risk_factors);
 
+        // Call f, returning the risk factors it read through this market on the calling thread,
+        // directly or via the curves it used, sorted by id. E.g. the dependencies of a trade are
+        // recorded while pricing it.
+        std::vector<risk_factor_id_t> record_reads(const std::function<void()> &f);
+
+        // risk factors a curve was built from, sorted by id (empty if the curve is not built)
+        std::vector<risk_factor_id_t> curve_dependencies(const string &name) const;
+
         // return all yield curve tenors (newly added)
         std::vector<std::string> get_all_yield_curve_tenors() const;
 
@@ -66,14 +141,80 @@ namespace minirisk
         void bump_all_yield_curves(double bump_size);
 
     private:
+        // A curve is built at most once: the first thread requesting it builds it while
+        // holding m_mutex, the others wait on the same mutex and find it ready.
+        struct curve_slot_t
+        {
+            std::mutex m_mutex;
+            std::atomic<bool> m_ready{false};
+            ptr_curve_t m_curve;
+            std::vector<risk_factor_id_t> m_dependencies; // risk factors read to build the curve, sorted
+        };
+
+        typedef std::map<string, std::shared_ptr<curve_slot_t>> curve_map_t;
+
+        typedef std::vector<std::pair<risk_factor_id_t, double>> overrides_t; // sorted by id
+
+        // The current curve map, read without locking nor reference counting: each thread keeps
+        // a reference to the maps it last read, tagged with their version, and while a map is
+        // current reading it costs an acquire load of m_curves_version
+        const curve_map_t &curve_map() const;
+
+        // replace the curve map, must hold m_mutex (or be called by a constructor)
+        void publish_curves(std::shared_ptr<const curve_map_t> curves);
+
+        // Return the slot associated to a curve name, creating an empty one if needed.
+        // Slots stay alive as long as a map holds them, i.e. until the market is modified.
+        curve_slot_t *curve_slot(const string &name);
+
+        // return the slot of a curve, building the curve if needed
+        template <typename T>
+        curve_slot_t *ready_slot(const string &name);
+
+        // value of a risk factor already fetched (or overlaid), false if not available
+        bool lookup(risk_factor_id_t id, double &value) const;
+
+        // store new values of fetched risk factors and destroy the curves built from them
+        void modify_risk_factors(overrides_t &&values);
+
+        // shift by bump_size the risk factors already fetched among the given ones
+        void bump_risk_factors(const std::vector<risk_factor_id_t> &ids, double bump_size);
+
+        // While a curve is built (or record_reads runs), the risk factors read through the market
+        // are logged, so that the curve can be destroyed when any of them changes
+        void log_read(risk_factor_id_t id) const;
+
+        // destroy the curves built from any of the given risk factors, must hold m_mutex
+        void invalidate_curves(std::vector<risk_factor_id_t> &&changed);
+
         Date m_today;
         std::shared_ptr<const MarketDataServer> m_mds;
+        std::shared_ptr<const market_snapshot_t> m_snapshot; // values fetched from m_mds
+        std::atomic<bool> m_df_grid;                         // see set_df_grid
 
-        // market curves
-        std::map<string, ptr_curve_t> m_curves;
+        // For an overlay, the market it is built on and the risk factors it modifies,
+        // an immutable snapshot replaced by writers. Both are null otherwise.
+        Market *m_base;
+        std::atomic<std::shared_ptr<const overrides_t>> m_overrides;
 
-        // raw risk factors
-        std::map<string, double> m_risk_factors;
+        // The map below is an immutable snapshot. Writers serialize on m_mutex and publish a
+        // modified copy with a new version, unique among all the maps of all the markets, so
+        // that readers find it in their cache (see curve_map). This is cheap because after
+        // the first pricing run the market only receives lookups.
+
+        // market curves
+        std::atomic<std::shared_ptr<const curve_map_t>> m_curves;
+        std::atomic<uint64_t> m_curves_version;
+
+        // Raw risk factors, indexed by the ids of the symbol table of the market data server,
+        // kept after disconnection. A value is valid once its flag is set (release/acquire),
+        // so fetched values are read without locking. Empty for an overlay.
+        std::shared_ptr<const risk_factor_table_t> m_symbols;
+        std::vector<std::atomic<double>> m_values;
+        std::vector<std::atomic<bool>> m_loaded;
+
+        // serializes writers of m_curves, m_values, m_overrides, m_mds and m_snapshot
+        mutable std::mutex m_mutex;
     };
 
 } // namespace minirisk
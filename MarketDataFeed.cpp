@@ -0,0 +1,122 @@
+#include "MarketDataFeed.h"
+
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace minirisk
+{
+
+    market_data_feed_t::market_data_feed_t(const std::shared_ptr<MarketDataServer> &mds, source_t source, std::chrono::milliseconds interval)
+        : m_mds(mds), m_source(std::move(source)), m_interval(interval), m_stop(false), m_running(true), m_n_updates(0)
+    {
+        MYASSERT(m_mds, "A market data feed requires a market data server");
+        m_thread = std::thread(&market_data_feed_t::worker, this);
+    }
+
+    market_data_feed_t::~market_data_feed_t()
+    {
+        join();
+    }
+
+    void market_data_feed_t::join()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    void market_data_feed_t::stop()
+    {
+        join();
+        if (m_error)
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+
+    void market_data_feed_t::worker()
+    {
+        try
+        {
+            ticks_t ticks;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_stop)
+            {
+                lock.unlock();
+                ticks.clear();
+                bool more = m_source(ticks);
+                if (!ticks.empty())
+                {
+                    m_mds->publish(ticks);
+                    ++m_n_updates;
+                }
+                lock.lock();
+                if (!more)
+                    break;
+                m_cv.wait_for(lock, m_interval, [this]()
+                              { return m_stop; });
+            }
+        }
+        catch (...)
+        {
+            m_error = std::current_exception();
+        }
+        m_running = false;
+    }
+
+    market_data_feed_t::source_t tick_file_source(const std::shared_ptr<const MarketDataServer> &mds, const string &filename)
+    {
+        auto is = std::make_shared<std::ifstream>(filename);
+        MYASSERT(!is->fail(), "Could not open file " << filename);
+        return [mds, is, filename](market_data_feed_t::ticks_t &ticks)
+        {
+            string line;
+            while (std::getline(*is, line))
+            {
+                std::istringstream ls(line);
+                string name;
+                double value;
+                if (!(ls >> name))
+                {
+                    if (ticks.empty())
+                        continue; // consecutive empty lines
+                    return true;
+                }
+                MYASSERT((ls >> value), "Invalid tick for " << name << " in file " << filename);
+                risk_factor_id_t id = mds->symbols()->find(name);
+                MYASSERT(id != invalid_risk_factor_id, "Unknown risk factor in tick file " << filename << ": " << name);
+                ticks.emplace_back(id, value);
+            }
+            return false;
+        };
+    }
+
+    market_data_feed_t::source_t simulated_tick_source(const std::shared_ptr<const MarketDataServer> &mds, size_t ticks_per_update, double volatility, unsigned seed)
+    {
+        const risk_factor_table_t &symbols = *mds->symbols();
+        std::vector<risk_factor_id_t> ids;
+        for (risk_factor_id_t id = 0; id < symbols.size(); ++id)
+            if (symbols.key(id).kind != risk_factor_kind_t::other)
+                ids.push_back(id);
+        MYASSERT(!ids.empty(), "No yield curve point nor FX spot to simulate");
+
+        auto rng = std::make_shared<std::mt19937>(seed);
+        return [mds, ids, ticks_per_update, volatility, rng](market_data_feed_t::ticks_t &ticks)
+        {
+            std::uniform_int_distribution<size_t> pick(0, ids.size() - 1);
+            std::normal_distribution<double> z;
+            auto snapshot = mds->snapshot();
+            for (size_t i = 0; i < ticks_per_update; ++i)
+            {
+                risk_factor_id_t id = ids[pick(*rng)];
+                ticks.emplace_back(id, snapshot->values[id] * std::exp(volatility * z(*rng)));
+            }
+            return true;
+        };
+    }
+
+} // namespace minirisk
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "MarketDataServer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace minirisk
+{
+
+    // Thread applying market data updates to a market data server, each update being published
+    // as a new snapshot. Pricing threads are not interrupted: markets keep the snapshot they were
+    // created with until refreshed (see Market::refresh).
+    struct market_data_feed_t
+    {
+        typedef std::vector<std::pair<risk_factor_id_t, double>> ticks_t;
+
+        // Source of the updates: fills ticks with the new values of the next update and
+        // returns false if no update follows. Called from the feed thread only.
+        typedef std::function<bool(ticks_t &)> source_t;
+
+        // start publishing one update per interval
+        market_data_feed_t(const std::shared_ptr<MarketDataServer> &mds, source_t source, std::chrono::milliseconds interval);
+
+        // stops the feed
+        ~market_data_feed_t();
+
+        market_data_feed_t(const market_data_feed_t &) = delete;
+        market_data_feed_t &operator=(const market_data_feed_t &) = delete;
+
+        // stop publishing and wait for the feed thread to exit, rethrowing its error if it failed
+        void stop();
+
+        // false once the source is exhausted, the feed failed or has been stopped
+        bool running() const { return m_running; }
+
+        // number of updates published so far
+        size_t n_updates() const { return m_n_updates; }
+
+    private:
+        void worker();
+        void join();
+
+        std::shared_ptr<MarketDataServer> m_mds;
+        source_t m_source;
+        std::chrono::milliseconds m_interval;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stop;
+        std::atomic<bool> m_running;
+        std::atomic<size_t> m_n_updates;
+        std::exception_ptr m_error;
+        std::thread m_thread;
+    };
+
+    // Replay the updates in a file. Each line is a tick "<risk factor> <value>", in the format of
+    // the risk factors file, and an empty line separates two updates.
+    market_data_feed_t::source_t tick_file_source(const std::shared_ptr<const MarketDataServer> &mds, const string &filename);
+
+    // Simulated ticks: every update moves ticks_per_update yield curve points and FX spots picked at
+    // random, each by a log-normal shock of the given volatility, value *= exp(volatility * z).
+    market_data_feed_t::source_t simulated_tick_source(const std::shared_ptr<const MarketDataServer> &mds, size_t ticks_per_update, double volatility, unsigned seed);
+
+} // namespace minirisk
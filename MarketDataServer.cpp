@@ -18,6 +18,7 @@ namespace minirisk
 
     MarketDataServer::MarketDataServer(const string &filename)
     {
+        std::map<string, double> data;
         std::ifstream is(filename);
         MYASSERT(!is.fail(), "Could not open file " << filename);
         do
@@ -26,23 +27,51 @@ namespace minirisk
             double value;
             is >> name >> value;
             // std::cout << name << " " << value << "\n";
-            auto ins = m_data.emplace(name, value);
+            auto ins = data.emplace(name, value);
             MYASSERT(ins.second, "Duplicated risk factor: " << name);
         } while (is);
+
+        // the map is sorted by name, as required by the symbol table
+        std::vector<string> names;
+        auto initial = std::make_shared<market_snapshot_t>();
+        initial->version = 0;
+        names.reserve(data.size());
+        initial->values.reserve(data.size());
+        for (const auto &d : data)
+        {
+            names.push_back(d.first);
+            initial->values.push_back(d.second);
+        }
+        m_symbols = std::make_shared<const risk_factor_table_t>(std::move(names));
+        m_snapshot.store(initial);
+    }
+
+    void MarketDataServer::publish(const std::vector<std::pair<risk_factor_id_t, double>> &ticks)
+    {
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        auto current = m_snapshot.load();
+        auto updated = std::make_shared<market_snapshot_t>(*current);
+        updated->version = current->version + 1;
+        for (const auto &t : ticks)
+        {
+            MYASSERT(t.first < m_symbols->size(), "Invalid risk factor id in market data update: " << t.first);
+            updated->values[t.first] = t.second;
+        }
+        m_snapshot.store(updated);
     }
 
     double MarketDataServer::get(const string &name) const
     {
-        auto iter = m_data.find(name);
-        MYASSERT(iter != m_data.end(), "Market data not found: " << name);
-        return iter->second;
+        risk_factor_id_t id = m_symbols->find(name);
+        MYASSERT(id != invalid_risk_factor_id, "Market data not found: " << name);
+        return get(id);
     }
 
     std::pair<double, bool> MarketDataServer::lookup(const string &name) const
     {
-        auto iter = m_data.find(name);
-        return (iter != m_data.end()) // found?
-                   ? std::make_pair(iter->second, true)
+        risk_factor_id_t id = m_symbols->find(name);
+        return (id != invalid_risk_factor_id) // found?
+                   ? std::make_pair(get(id), true)
                    : std::make_pair(std::numeric_limits<double>::quiet_NaN(), false);
     }
 
@@ -50,12 +79,13 @@ namespace minirisk
     {
         std::regex r(expr);
         std::vector<std::pair<std::string, double> > matched_data;
+        auto snapshot = m_snapshot.load();
 
-        for (const auto &data : m_data)
+        for (risk_factor_id_t id = 0; id < m_symbols->size(); ++id)
         {
-            if (std::regex_match(data.first, r))
+            if (std::regex_match(m_symbols->name(id), r))
             {
-                matched_data.emplace_back(data.first, data.second);
+                matched_data.emplace_back(m_symbols->name(id), snapshot->values[id]);
             }
         }
 
@@ -1,27 +1,57 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
+#include <vector>
 #include "Global.h"
+#include "RiskFactors.h"
 
 namespace minirisk {
 
+// Immutable values of all the risk factors at a point in time. Readers holding a snapshot
+// always see consistent values, whatever is published meanwhile.
+struct market_snapshot_t
+{
+    uint64_t version;           // 0 for the initial data, incremented by every publication
+    std::vector<double> values; // indexed by risk factor id
+};
+
 // This is a dummy object that in a real system should be replaced by a server providing
 // with real time (or historical) market data on demand and capable to produce snapshots of data.
-// For the purpose of this example this simply serves to clients some stale pre-loaded market info.
+// For the purpose of this example this serves to clients some pre-loaded market info,
+// which can be updated by a feed (see MarketDataFeed.h) publishing new snapshots.
 struct MarketDataServer
 {
 public:
     MarketDataServer(const string& filename);
 
-    // queries
+    // queries, on the latest snapshot
     double get(const string& name) const;
     std::pair<double, bool> lookup(const string& name) const;
-    std::vector<std::string> match(const std::string& expr) const;
+    std::vector<std::pair<std::string, double>> match(const std::string& expr) const;
+
+    // query by id, which must be valid in symbols()
+    double get(risk_factor_id_t id) const { return snapshot()->values[id]; }
+
+    // the names of all the risk factors served, with their ids (the same for all snapshots)
+    const std::shared_ptr<const risk_factor_table_t>& symbols() const { return m_symbols; }
+
+    // the latest snapshot, obtained without locking
+    std::shared_ptr<const market_snapshot_t> snapshot() const { return m_snapshot.load(); }
+
+    // Publish a new snapshot with the given risk factors set to new values. Readers are never
+    // blocked: they keep using the snapshot they hold and see the new one on their next request.
+    void publish(const std::vector<std::pair<risk_factor_id_t, double>>& ticks);
 
 private:
     // for simplicity, assumes market data can only have type double
-    std::map<string, double> m_data;
+    std::shared_ptr<const risk_factor_table_t> m_symbols;
+    std::atomic<std::shared_ptr<const market_snapshot_t>> m_snapshot;
+    std::mutex m_publish_mutex; // serializes publishers
 };
 
 string mds_spot_name(const string& name);
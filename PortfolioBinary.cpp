@@ -0,0 +1,273 @@
+#include "PortfolioBinary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#ifdef _WIN32
+#    define NOMINMAX
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace minirisk
+{
+
+    namespace
+    {
+        const char portfolio_file_magic[8] = {'M', 'R', 'P', 'O', 'R', 'T', 'F', '\0'};
+        const uint32_t portfolio_file_byte_order = 0x01020304;
+
+        // the columns are used in place, so their in-memory layout must match the file
+        static_assert(sizeof(size_t) == sizeof(uint64_t), "row column requires 64 bit size_t");
+        static_assert(sizeof(Date) == sizeof(uint32_t) && std::is_trivially_copyable_v<Date>, "delivery column requires Date to be a 32 bit serial");
+
+        uint64_t align8(uint64_t n)
+        {
+            return (n + 7) & ~uint64_t(7);
+        }
+
+        template <typename T>
+        void write_column(std::ofstream &of, uint64_t &pos, uint64_t offset, const std::vector<T> &v)
+        {
+            static const char zeros[8] = {};
+            of.write(zeros, offset - pos);
+            of.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+            pos = offset + v.size() * sizeof(T);
+        }
+    } // namespace
+
+    bool is_binary_portfolio(const std::string &filename)
+    {
+        char magic[sizeof(portfolio_file_magic)] = {};
+        std::ifstream is(filename, std::ios::binary);
+        is.read(magic, sizeof(magic));
+        return is && std::memcmp(magic, portfolio_file_magic, sizeof(magic)) == 0;
+    }
+
+    void save_portfolio_binary(const std::string &filename, const portfolio_columns_t &columns)
+    {
+        const payment_columns_t &payments = columns.payments;
+        const uint64_t n = payments.size();
+
+        portfolio_file_header_t h = {};
+        std::memcpy(h.magic, portfolio_file_magic, sizeof(h.magic));
+        h.version = portfolio_file_version;
+        h.byte_order = portfolio_file_byte_order;
+        h.n_trades = columns.size();
+        h.n_payments = n;
+        h.n_ccy = columns.ccy_names.size();
+        h.offset_ccy = align8(sizeof(h));
+        h.offset_row = align8(h.offset_ccy + h.n_ccy * sizeof(portfolio_file_ccy_t));
+        h.offset_quantity = align8(h.offset_row + n * sizeof(uint64_t));
+        h.offset_delivery = align8(h.offset_quantity + n * sizeof(double));
+        h.offset_ccy_id = align8(h.offset_delivery + n * sizeof(uint32_t));
+        h.file_size = h.offset_ccy_id + n * sizeof(uint16_t);
+
+        std::vector<portfolio_file_ccy_t> ccys(h.n_ccy);
+        for (size_t c = 0; c < ccys.size(); ++c)
+        {
+            const std::string &name = columns.ccy_names[c];
+            MYASSERT(name.size() < sizeof(ccys[c].name), "Currency name too long for binary portfolio file: " << name);
+            std::memset(ccys[c].name, 0, sizeof(ccys[c].name));
+            std::memcpy(ccys[c].name, name.data(), name.size());
+        }
+
+        std::ofstream of(filename, std::ios::binary | std::ios::trunc);
+        MYASSERT(of, "Could not open file " << filename);
+        of.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        uint64_t pos = sizeof(h);
+        write_column(of, pos, h.offset_ccy, ccys);
+        write_column(of, pos, h.offset_row, payments.row);
+        write_column(of, pos, h.offset_quantity, payments.quantity);
+        write_column(of, pos, h.offset_delivery, payments.delivery);
+        write_column(of, pos, h.offset_ccy_id, payments.ccy);
+        of.close();
+        MYASSERT(of, "Error writing file " << filename);
+    }
+
+    mapped_portfolio_t::mapped_portfolio_t(const std::string &filename)
+        : m_data(nullptr), m_size(0)
+#ifdef _WIN32
+        , m_file(nullptr), m_mapping(nullptr)
+#endif
+    {
+        map(filename);
+        try
+        {
+            portfolio_file_header_t h;
+            MYASSERT(m_size >= sizeof(h), "File " << filename << " is too short to be a binary portfolio");
+            std::memcpy(&h, m_data, sizeof(h));
+            MYASSERT(std::memcmp(h.magic, portfolio_file_magic, sizeof(h.magic)) == 0, "File " << filename << " is not a binary portfolio");
+            MYASSERT(h.byte_order == portfolio_file_byte_order, "Binary portfolio " << filename << " was written on a machine with a different byte order");
+            MYASSERT(h.version == portfolio_file_version, "Unsupported binary portfolio version " << h.version << " in file " << filename << ", expected " << portfolio_file_version);
+            MYASSERT(h.file_size == m_size, "Binary portfolio " << filename << " is truncated or corrupted: expected " << h.file_size << " bytes, got " << m_size);
+            MYASSERT(h.n_payments == h.n_trades, "Binary portfolio " << filename << " has " << h.n_trades << " trades but " << h.n_payments << " payments");
+
+            // every section must lie within the file and be aligned for its element type
+            auto check = [&](uint64_t offset, uint64_t count, uint64_t elem_size)
+            {
+                MYASSERT(offset % 8 == 0 && offset <= m_size && count <= (m_size - offset) / elem_size, "Binary portfolio " << filename << " is corrupted: invalid section at offset " << offset);
+            };
+            check(h.offset_ccy, h.n_ccy, sizeof(portfolio_file_ccy_t));
+            check(h.offset_row, h.n_payments, sizeof(uint64_t));
+            check(h.offset_quantity, h.n_payments, sizeof(double));
+            check(h.offset_delivery, h.n_payments, sizeof(uint32_t));
+            check(h.offset_ccy_id, h.n_payments, sizeof(uint16_t));
+
+            const portfolio_file_ccy_t *ccys = reinterpret_cast<const portfolio_file_ccy_t *>(m_data + h.offset_ccy);
+            for (size_t c = 0; c < h.n_ccy; ++c)
+                m_ccy_names.emplace_back(ccys[c].name, strnlen(ccys[c].name, sizeof(ccys[c].name)));
+
+            const size_t n = h.n_payments;
+            payment_columns_view_t &p = m_columns.payments;
+            p.row = std::span<const size_t>(reinterpret_cast<const size_t *>(m_data + h.offset_row), n);
+            p.quantity = std::span<const double>(reinterpret_cast<const double *>(m_data + h.offset_quantity), n);
+            p.delivery = std::span<const Date>(reinterpret_cast<const Date *>(m_data + h.offset_delivery), n);
+            p.ccy = std::span<const uint16_t>(reinterpret_cast<const uint16_t *>(m_data + h.offset_ccy_id), n);
+            m_columns.ccy_names = m_ccy_names;
+            m_columns.n_trades = h.n_trades;
+
+            // Indices and dates are used without further checks by the pricers (dates are packed
+            // in the keys of net_cashflows), validate them once here
+            const unsigned max_serial = Date::compute_serial(Date::last_year - 1, 12, 31);
+            for (size_t i = 0; i < n; ++i)
+                MYASSERT(p.row[i] < h.n_trades && (i == 0 || p.row[i - 1] < p.row[i]) && p.ccy[i] < h.n_ccy && p.delivery[i].get_serial() <= max_serial, "Binary portfolio " << filename << " is corrupted: invalid payment " << i);
+        }
+        catch (...)
+        {
+            unmap();
+            throw;
+        }
+    }
+
+    mapped_portfolio_t::~mapped_portfolio_t()
+    {
+        unmap();
+    }
+
+#ifdef _WIN32
+    void mapped_portfolio_t::map(const std::string &filename)
+    {
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        MYASSERT(file != INVALID_HANDLE_VALUE, "Could not open file " << filename);
+        m_file = file;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            unmap();
+            THROW("Could not get the size of file " << filename);
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        if (m_size == 0)
+            return;
+        m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping)
+            m_data = static_cast<const char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!m_data)
+        {
+            unmap();
+            THROW("Could not map file " << filename);
+        }
+    }
+
+    void mapped_portfolio_t::unmap()
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file)
+            CloseHandle(m_file);
+        m_data = nullptr;
+        m_mapping = nullptr;
+        m_file = nullptr;
+        m_size = 0;
+    }
+#else
+    void mapped_portfolio_t::map(const std::string &filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        MYASSERT(fd >= 0, "Could not open file " << filename);
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            THROW("Could not get the size of file " << filename);
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        if (m_size == 0)
+        {
+            ::close(fd);
+            return;
+        }
+        void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file open
+        if (data == MAP_FAILED)
+        {
+            m_size = 0;
+            THROW("Could not map file " << filename);
+        }
+        ::madvise(data, m_size, MADV_SEQUENTIAL); // columns are scanned front to back
+        m_data = static_cast<const char *>(data);
+    }
+
+    void mapped_portfolio_t::unmap()
+    {
+        if (m_data)
+            ::munmap(const_cast<char *>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+#endif
+
+    portfolio_t mapped_portfolio_t::trades(size_t begin, size_t end) const
+    {
+        MYASSERT(begin <= end && end <= size(), "Invalid trade range [" << begin << ", " << end << ") for a portfolio of " << size() << " trades");
+        const payment_columns_view_t &p = m_columns.payments;
+        portfolio_t portfolio(end - begin);
+
+        // rows are sorted, so the payments in the range are contiguous
+        size_t first = std::lower_bound(p.row.begin(), p.row.end(), begin) - p.row.begin();
+        for (size_t i = first; i < p.size() && p.row[i] < end; ++i)
+        {
+            std::shared_ptr<TradePayment> t(new TradePayment);
+            t->init(m_ccy_names[p.ccy[i]], p.quantity[i], p.delivery[i]);
+            portfolio[p.row[i] - begin] = t;
+        }
+        return portfolio;
+    }
+
+    void load_portfolio_binary(const std::string &filename, portfolio_columns_t &columns)
+    {
+        mapped_portfolio_t mapped(filename);
+        const portfolio_columns_view_t &v = mapped.columns();
+
+        columns.clear();
+        columns.ccy_names.assign(v.ccy_names.begin(), v.ccy_names.end());
+        columns.payments.row.assign(v.payments.row.begin(), v.payments.row.end());
+        columns.payments.quantity.assign(v.payments.quantity.begin(), v.payments.quantity.end());
+        columns.payments.ccy.assign(v.payments.ccy.begin(), v.payments.ccy.end());
+        columns.payments.delivery.assign(v.payments.delivery.begin(), v.payments.delivery.end());
+        columns.n_trades = v.size();
+    }
+
+    void convert_portfolio_to_binary(const std::string &text_filename, const std::string &binary_filename)
+    {
+        portfolio_columns_t columns;
+        load_portfolio(text_filename, columns);
+        save_portfolio_binary(binary_filename, columns);
+    }
+
+    void convert_portfolio_to_text(const std::string &binary_filename, const std::string &text_filename)
+    {
+        mapped_portfolio_t mapped(binary_filename);
+        save_portfolio(text_filename, mapped.trades());
+    }
+
+} // namespace minirisk
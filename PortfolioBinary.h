@@ -0,0 +1,100 @@
+#pragma once
+
+#include "PortfolioColumns.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace minirisk
+{
+
+// Binary portfolio file format.
+//
+// The file is an image of the columnar storage of portfolio_columns_t, so it can be memory
+// mapped and used in place, without parsing. All numbers are in the byte order of the
+// machine which wrote the file (checked when reading). Layout, version 1:
+//
+//   portfolio_file_header_t
+//   currency names, n_ccy entries of portfolio_file_ccy_t
+//   payment columns, n_payments elements each, at the offsets given in the header:
+//     row       uint64   position of the trade in the portfolio
+//     quantity  double
+//     delivery  uint32   Date serial
+//     ccy       uint16   index in the currency names
+//
+// Within each trade type, trades are stored by increasing position in the portfolio.
+// Every section starts at a multiple of 8 bytes from the beginning of the file.
+
+const uint32_t portfolio_file_version = 1;
+
+struct portfolio_file_header_t
+{
+    char magic[8];            // "MRPORTF" followed by a zero
+    uint32_t version;         // portfolio_file_version
+    uint32_t byte_order;      // 0x01020304, as written by the producing machine
+    uint64_t file_size;       // total size in bytes, to detect truncated files
+    uint64_t n_trades;
+    uint64_t n_payments;
+    uint64_t n_ccy;
+    uint64_t offset_ccy;      // offsets of the sections from the beginning of the file
+    uint64_t offset_row;
+    uint64_t offset_quantity;
+    uint64_t offset_delivery;
+    uint64_t offset_ccy_id;
+};
+
+struct portfolio_file_ccy_t
+{
+    char name[8]; // zero padded
+};
+
+// Read-only portfolio backed by a memory mapped binary portfolio file.
+// The columns point directly into the mapped file, which stays mapped until destruction.
+struct mapped_portfolio_t
+{
+    explicit mapped_portfolio_t(const std::string &filename);
+    ~mapped_portfolio_t();
+
+    mapped_portfolio_t(const mapped_portfolio_t &) = delete;
+    mapped_portfolio_t &operator=(const mapped_portfolio_t &) = delete;
+
+    size_t size() const { return m_columns.size(); }
+
+    // zero-copy view of the trades, which can be priced with compute_prices
+    const portfolio_columns_view_t &columns() const { return m_columns; }
+
+    // create the trade objects
+    portfolio_t trades() const { return trades(0, size()); }
+
+    // create the objects of the trades at positions [begin, end) of the portfolio
+    portfolio_t trades(size_t begin, size_t end) const;
+
+private:
+    void map(const std::string &filename);
+    void unmap();
+
+    const char *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#endif
+    std::vector<std::string> m_ccy_names;
+    portfolio_columns_view_t m_columns;
+};
+
+// true if the file starts with the binary portfolio signature
+bool is_binary_portfolio(const std::string &filename);
+
+// write the columns to a binary portfolio file
+void save_portfolio_binary(const std::string &filename, const portfolio_columns_t &columns);
+
+// read a binary portfolio file into columnar storage
+void load_portfolio_binary(const std::string &filename, portfolio_columns_t &columns);
+
+// Converters between the text format of save_portfolio and the binary format
+void convert_portfolio_to_binary(const std::string &text_filename, const std::string &binary_filename);
+void convert_portfolio_to_text(const std::string &binary_filename, const std::string &text_filename);
+
+} // namespace minirisk
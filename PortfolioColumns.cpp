@@ -0,0 +1,234 @@
+#include "PortfolioColumns.h"
+#include "PortfolioBinary.h"
+#include "Global.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace minirisk
+{
+
+    uint16_t portfolio_columns_t::ccy_id(const std::string &ccy)
+    {
+        // few distinct currencies, a linear scan is fast enough
+        auto iter = std::find(ccy_names.begin(), ccy_names.end(), ccy);
+        if (iter != ccy_names.end())
+            return static_cast<uint16_t>(iter - ccy_names.begin());
+        MYASSERT(ccy_names.size() < std::numeric_limits<uint16_t>::max(), "Too many currencies in portfolio");
+        ccy_names.push_back(ccy);
+        return static_cast<uint16_t>(ccy_names.size() - 1);
+    }
+
+    void portfolio_columns_t::push_back(const ITrade &trade)
+    {
+        if (trade.id() == TradePayment::m_id)
+        {
+            const TradePayment &p = static_cast<const TradePayment &>(trade);
+            payments.row.push_back(n_trades);
+            payments.quantity.push_back(p.quantity());
+            payments.ccy.push_back(ccy_id(p.ccy()));
+            payments.delivery.push_back(p.delivery_date());
+        }
+        else
+            THROW("Unknown trade type: " << trade.id());
+        ++n_trades;
+    }
+
+    void portfolio_columns_t::clear()
+    {
+        ccy_names.clear();
+        payments = payment_columns_t();
+        n_trades = 0;
+    }
+
+    portfolio_columns_view_t portfolio_columns_t::view() const
+    {
+        portfolio_columns_view_t v;
+        v.ccy_names = ccy_names;
+        v.payments.row = payments.row;
+        v.payments.quantity = payments.quantity;
+        v.payments.ccy = payments.ccy;
+        v.payments.delivery = payments.delivery;
+        v.n_trades = n_trades;
+        return v;
+    }
+
+    void load_portfolio(const std::string &filename, portfolio_columns_t &columns)
+    {
+        if (is_binary_portfolio(filename))
+        {
+            load_portfolio_binary(filename, columns);
+            return;
+        }
+
+        columns.clear();
+
+        // a single trade object per type is reused to parse all the lines
+        TradePayment payment;
+
+        my_ifstream is(filename);
+        while (is.read_line())
+        {
+            guid_t id;
+            is >> id;
+            if (id == TradePayment::m_id)
+            {
+                payment.load(is);
+                columns.push_back(payment);
+            }
+            else
+                THROW("Unknown trade type: " << id);
+        }
+    }
+
+    portfolio_columns_t to_columns(const portfolio_t &portfolio)
+    {
+        portfolio_columns_t columns;
+        for (const auto &pt : portfolio)
+            columns.push_back(*pt);
+        return columns;
+    }
+
+    cashflow_ladder_t net_cashflows(const portfolio_columns_view_t &columns)
+    {
+        cashflow_ladder_t ladder;
+        const payment_columns_view_t &payments = columns.payments;
+
+        // Order the payments by (currency, delivery date) with a least significant digit radix
+        // sort of the packed keys. The cost is linear in the number of payments.
+        const unsigned serial_bits = 17;
+        static_assert(Date::compute_serial(Date::last_year - 1, 12, 31) < (1u << serial_bits), "Date serials must fit in the keys");
+        std::vector<uint64_t> keys(payments.size());
+        uint64_t max_key = 0;
+        for (size_t i = 0; i < payments.size(); ++i)
+        {
+            keys[i] = (uint64_t(payments.ccy[i]) << serial_bits) | payments.delivery[i].get_serial();
+            max_key = std::max(max_key, keys[i]);
+        }
+
+        const unsigned digit_bits = 11;
+        const size_t n_buckets = size_t(1) << digit_bits;
+        std::vector<size_t> order(payments.size()), sorted(payments.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        for (unsigned shift = 0; shift < 64 && (max_key >> shift) != 0; shift += digit_bits)
+        {
+            std::vector<size_t> start(n_buckets + 1, 0);
+            for (size_t i : order)
+                ++start[((keys[i] >> shift) & (n_buckets - 1)) + 1];
+            std::partial_sum(start.begin(), start.end(), start.begin());
+            for (size_t i : order)
+                sorted[start[(keys[i] >> shift) & (n_buckets - 1)]++] = i;
+            order.swap(sorted);
+        }
+
+        ladder.cashflow.resize(payments.size());
+        for (size_t j = 0; j < order.size(); ++j)
+        {
+            size_t i = order[j];
+            if (j == 0 || keys[i] != keys[order[j - 1]])
+            {
+                ladder.ccy.push_back(payments.ccy[i]);
+                ladder.delivery.push_back(payments.delivery[i]);
+            }
+            ladder.cashflow[i] = ladder.size() - 1;
+        }
+        return ladder;
+    }
+
+    // Value of one unit of each cashflow of the ladder in [begin, end), all in the same
+    // currency, as a discount factor and an fx rate. Cashflows which cannot be priced are
+    // flagged as failed, with their error message.
+    static void price_cashflows(const cashflow_ladder_t &ladder, const std::string &ccy, size_t begin, size_t end, Market &mkt, std::vector<double> &df, std::vector<double> &fx, std::vector<bool> &failed, std::vector<string> &errors)
+    {
+        auto fail = [&](size_t k, const char *msg)
+        {
+            failed[k] = true;
+            errors[k] = msg;
+        };
+
+        // errors are checked in the same order as PricerPayment: curve, discount factor, fx rate
+        ptr_disc_curve_t disc;
+        try
+        {
+            disc = mkt.get_discount_curve(ir_curve_discount_name(ccy));
+        }
+        catch (const std::exception &e)
+        {
+            for (size_t k = begin; k < end; ++k)
+                fail(k, e.what());
+            return;
+        }
+
+        std::span<const Date> dates(ladder.delivery.data() + begin, end - begin);
+        try
+        {
+            disc->df_batch(dates, std::span<double>(df.data() + begin, end - begin));
+        }
+        catch (const std::exception &)
+        {
+            // some dates are not valid: go through them one by one to report the right error
+            for (size_t k = begin; k < end; ++k)
+            {
+                try
+                {
+                    df[k] = disc->df(ladder.delivery[k]);
+                }
+                catch (const std::exception &e)
+                {
+                    fail(k, e.what());
+                }
+            }
+        }
+
+        double rate = 1.0;
+        if (ccy != "USD")
+        {
+            try
+            {
+                rate = mkt.get_fx_spot(fx_spot_name(ccy, "USD"));
+            }
+            catch (const std::exception &e)
+            {
+                for (size_t k = begin; k < end; ++k)
+                    if (!failed[k])
+                        fail(k, e.what());
+                return;
+            }
+        }
+        std::fill(fx.begin() + begin, fx.begin() + end, rate);
+    }
+
+    portfolio_values_t compute_prices(const portfolio_columns_view_t &columns, Market &mkt)
+    {
+        portfolio_values_t prices(columns.size());
+
+        // price every cashflow of the ladder, one currency (a range of the ladder) at a time
+        cashflow_ladder_t ladder = net_cashflows(columns);
+        std::vector<double> df(ladder.size()), fx(ladder.size());
+        std::vector<bool> failed(ladder.size(), false);
+        std::vector<string> errors(ladder.size());
+        for (size_t begin = 0, end; begin < ladder.size(); begin = end)
+        {
+            end = begin + 1;
+            while (end < ladder.size() && ladder.ccy[end] == ladder.ccy[begin])
+                ++end;
+            price_cashflows(ladder, columns.ccy_names[ladder.ccy[begin]], begin, end, mkt, df, fx, failed, errors);
+        }
+
+        // value every payment from the unit value of its cashflow, with the same rounding as
+        // PricerPayment::value (fx is exactly 1 for USD, where PricerPayment skips it)
+        const payment_columns_view_t &payments = columns.payments;
+        for (size_t i = 0; i < payments.size(); ++i)
+        {
+            size_t k = ladder.cashflow[i];
+            if (!failed[k])
+                prices[payments.row[i]].first = payments.quantity[i] * (df[k] * fx[k]);
+            else
+                prices[payments.row[i]] = std::make_pair(std::numeric_limits<double>::quiet_NaN(), errors[k]);
+        }
+
+        return prices;
+    }
+
+} // namespace minirisk
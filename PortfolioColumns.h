@@ -0,0 +1,106 @@
+#pragma once
+
+#include "PortfolioUtils.h"
+#include "TradePayment.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace minirisk
+{
+
+// Payments stored column by column. Element i of every column refers to the same trade.
+struct payment_columns_t
+{
+    std::vector<size_t> row;        // position of the trade in the portfolio
+    std::vector<double> quantity;
+    std::vector<uint16_t> ccy;      // index in portfolio_columns_t::ccy_names
+    std::vector<Date> delivery;     // a Date only holds its serial, so this is a column of serials
+
+    size_t size() const { return row.size(); }
+};
+
+// Read-only view of payment columns whose storage is owned elsewhere
+// (a payment_columns_t or a memory mapped portfolio file)
+struct payment_columns_view_t
+{
+    std::span<const size_t> row;
+    std::span<const double> quantity;
+    std::span<const uint16_t> ccy;
+    std::span<const Date> delivery;
+
+    size_t size() const { return row.size(); }
+};
+
+// Read-only view of a columnar portfolio
+struct portfolio_columns_view_t
+{
+    size_t size() const { return n_trades; }
+
+    std::span<const std::string> ccy_names;
+    payment_columns_view_t payments;
+    size_t n_trades = 0;
+};
+
+// Columnar (structure of arrays) representation of a portfolio: trades are not individual
+// heap objects, but entries of contiguous columns, grouped by trade type.
+// Walking the portfolio is then a sequential scan of a few arrays.
+struct portfolio_columns_t
+{
+    // number of trades of all types
+    size_t size() const { return n_trades; }
+
+    // return the id of a currency, registering it if not known yet
+    uint16_t ccy_id(const std::string &ccy);
+
+    // append a trade after the existing ones
+    void push_back(const ITrade &trade);
+
+    void clear();
+
+    portfolio_columns_view_t view() const;
+
+    std::vector<std::string> ccy_names;
+    payment_columns_t payments;
+    size_t n_trades = 0;
+};
+
+// Net cashflows of the payments of a portfolio: one entry per distinct (currency, delivery date),
+// sorted by currency then delivery date.
+struct cashflow_ladder_t
+{
+    std::vector<uint16_t> ccy;        // index in portfolio_columns_t::ccy_names
+    std::vector<Date> delivery;
+    std::vector<size_t> cashflow;     // cashflow of each payment, indexed like the payment columns
+
+    size_t size() const { return ccy.size(); }
+};
+
+// Group the payments into their net cashflows
+cashflow_ladder_t net_cashflows(const portfolio_columns_view_t &columns);
+
+// Fill the columns with the trades in the file, without creating a trade object for each.
+// Both the text and the binary (see PortfolioBinary.h) formats are accepted.
+void load_portfolio(const std::string &filename, portfolio_columns_t &columns);
+
+// Convert a portfolio of trade objects to columns
+portfolio_columns_t to_columns(const portfolio_t &portfolio);
+
+// Price all trades in the columns. The result has the same layout as compute_prices
+// applied to the pricers of the same portfolio: one entry per trade in portfolio order,
+// NaN and an error message for trades which cannot be priced.
+// Payments are first grouped into cashflows (see net_cashflows), so curves and fx rates are
+// looked up once per currency and discount factors computed with ICurveDiscount::df_batch
+// once per distinct delivery date. Each payment is then valued as PricerPayment does,
+// quantity * (df * fx), so the prices are the same to the last bit whenever df_batch
+// returns the same discount factors as df (see ICurveDiscount::df_batch).
+portfolio_values_t compute_prices(const portfolio_columns_view_t &columns, Market &mkt);
+
+inline portfolio_values_t compute_prices(const portfolio_columns_t &columns, Market &mkt)
+{
+    return compute_prices(columns.view(), mkt);
+}
+
+} // namespace minirisk
@@ -0,0 +1,51 @@
+#include <iostream>
+
+#include "PortfolioBinary.h"
+
+using namespace ::minirisk;
+
+void usage()
+{
+    std::cerr
+        << "Invalid command line arguments\n"
+        << "Example:\n"
+        << "PortfolioConvert -i portfolio.txt -o portfolio.bin\n"
+        << "PortfolioConvert -i portfolio.bin -o portfolio.txt\n"
+        << "The direction is given by the format of the input file.\n";
+    std::exit(-1);
+}
+
+int main(int argc, const char **argv)
+{
+    // parse command line arguments
+    string input, output;
+    if (argc % 2 == 0)
+        usage();
+    for (int i = 1; i < argc; i += 2)
+    {
+        string key(argv[i]);
+        string value(argv[i + 1]);
+        if (key == "-i")
+            input = value;
+        else if (key == "-o")
+            output = value;
+        else
+            usage();
+    }
+    if (input == "" || output == "")
+        usage();
+
+    try
+    {
+        if (is_binary_portfolio(input))
+            convert_portfolio_to_text(input, output);
+        else
+            convert_portfolio_to_binary(input, output);
+        return 0; // report success to the caller
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n";
+        return -1; // report an error to the caller
+    }
+}
@@ -0,0 +1,164 @@
+#include "PortfolioIncremental.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace minirisk
+{
+
+    incremental_pricer_t::incremental_pricer_t(const std::vector<ppricer_t> &pricers, Market &mkt)
+        : m_pricers(pricers), m_mkt(mkt), m_pool(nullptr), m_total(0.0), m_n_errors(0)
+    {
+        price_all();
+    }
+
+    incremental_pricer_t::incremental_pricer_t(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool)
+        : m_pricers(pricers), m_mkt(mkt), m_pool(&pool), m_total(0.0), m_n_errors(0)
+    {
+        price_all();
+    }
+
+    // call body on consecutive ranges of [0, n), on the pool if any
+    static void for_ranges(size_t n, ThreadPool *pool, const std::function<void(size_t, size_t)> &body)
+    {
+        if (pool)
+            pool->parallel_for(n, pool->default_grain(n), body);
+        else if (n > 0)
+            body(0, n);
+    }
+
+    // price a trade, storing the error message if it cannot be priced
+    static portfolio_values_t::value_type price_trade(const ppricer_t &pricer, Market &mkt)
+    {
+        try
+        {
+            return std::make_pair(pricer->price(mkt), string());
+        }
+        catch (const std::exception &e)
+        {
+            return std::make_pair(std::numeric_limits<double>::quiet_NaN(), string(e.what()));
+        }
+    }
+
+    void incremental_pricer_t::price_all()
+    {
+        const size_t n = m_pricers.size();
+        m_prices.resize(n);
+
+        // record what each trade reads, failed trades included: they are retried when it changes
+        std::vector<std::vector<risk_factor_id_t>> deps(n);
+        for_ranges(n, m_pool, [&](size_t begin, size_t end)
+                   {
+            for (size_t i = begin; i < end; ++i)
+                deps[i] = m_mkt.record_reads([&]()
+                                             { m_prices[i] = price_trade(m_pricers[i], m_mkt); }); });
+
+        for (const auto &p : m_prices)
+        {
+            if (std::isnan(p.first))
+                ++m_n_errors;
+            else
+                m_total += p.first;
+        }
+
+        build_graph(deps);
+    }
+
+    void incremental_pricer_t::build_graph(const std::vector<std::vector<risk_factor_id_t>> &deps)
+    {
+        const size_t n = deps.size();
+
+        // trade -> risk factors
+        m_rf_offsets.assign(n + 1, 0);
+        for (size_t i = 0; i < n; ++i)
+            m_rf_offsets[i + 1] = m_rf_offsets[i] + deps[i].size();
+        m_rf_ids.resize(m_rf_offsets[n]);
+        for (size_t i = 0; i < n; ++i)
+            std::copy(deps[i].begin(), deps[i].end(), m_rf_ids.begin() + m_rf_offsets[i]);
+
+        // risk factor -> trades, by counting sort on the risk factor
+        const size_t n_rf = m_mkt.symbols().size();
+        m_trade_offsets.assign(n_rf + 1, 0);
+        for (risk_factor_id_t id : m_rf_ids)
+            ++m_trade_offsets[id + 1];
+        for (size_t id = 0; id < n_rf; ++id)
+            m_trade_offsets[id + 1] += m_trade_offsets[id];
+        m_trades.resize(m_rf_ids.size());
+        std::vector<size_t> next(m_trade_offsets.begin(), m_trade_offsets.end() - 1);
+        for (size_t i = 0; i < n; ++i)
+            for (size_t k = m_rf_offsets[i]; k < m_rf_offsets[i + 1]; ++k)
+                m_trades[next[m_rf_ids[k]]++] = i;
+    }
+
+    size_t incremental_pricer_t::update(const std::vector<risk_factor_id_t> &changed)
+    {
+        std::vector<size_t> trades;
+        for (risk_factor_id_t id : changed)
+        {
+            MYASSERT(id + 1 < m_trade_offsets.size(), "Invalid risk factor id " << id);
+            trades.insert(trades.end(), m_trades.begin() + m_trade_offsets[id], m_trades.begin() + m_trade_offsets[id + 1]);
+        }
+        std::sort(trades.begin(), trades.end());
+        trades.erase(std::unique(trades.begin(), trades.end()), trades.end());
+
+        reprice(trades);
+        return trades.size();
+    }
+
+    void incremental_pricer_t::reprice(const std::vector<size_t> &trades)
+    {
+        // Record the reads again: a trade may now read risk factors it did not reach before,
+        // e.g. when it failed part way through and can now be priced
+        portfolio_values_t updated(trades.size());
+        std::vector<std::vector<risk_factor_id_t>> updated_deps(trades.size());
+        for_ranges(trades.size(), m_pool, [&](size_t begin, size_t end)
+                   {
+            for (size_t k = begin; k < end; ++k)
+                updated_deps[k] = m_mkt.record_reads([&]()
+                                                     { updated[k] = price_trade(m_pricers[trades[k]], m_mkt); }); });
+
+        // adjust the total by the difference of each repriced trade
+        for (size_t k = 0; k < trades.size(); ++k)
+        {
+            auto &price = m_prices[trades[k]];
+            if (std::isnan(price.first))
+                --m_n_errors;
+            else
+                m_total -= price.first;
+            if (std::isnan(updated[k].first))
+                ++m_n_errors;
+            else
+                m_total += updated[k].first;
+            price = std::move(updated[k]);
+        }
+
+        // rebuild the dependency graph if the dependencies of any repriced trade changed
+        bool changed = false;
+        for (size_t k = 0; k < trades.size() && !changed; ++k)
+            changed = !std::equal(updated_deps[k].begin(), updated_deps[k].end(), m_rf_ids.begin() + m_rf_offsets[trades[k]], m_rf_ids.begin() + m_rf_offsets[trades[k] + 1]);
+        if (changed)
+        {
+            std::vector<std::vector<risk_factor_id_t>> deps(m_pricers.size());
+            for (size_t i = 0; i < deps.size(); ++i)
+                deps[i] = dependencies(i);
+            for (size_t k = 0; k < trades.size(); ++k)
+                deps[trades[k]] = std::move(updated_deps[k]);
+            build_graph(deps);
+        }
+    }
+
+    std::vector<risk_factor_id_t> incremental_pricer_t::dependencies(size_t trade) const
+    {
+        MYASSERT(trade < m_pricers.size(), "Invalid trade position " << trade);
+        return std::vector<risk_factor_id_t>(m_rf_ids.begin() + m_rf_offsets[trade], m_rf_ids.begin() + m_rf_offsets[trade + 1]);
+    }
+
+    std::vector<size_t> incremental_pricer_t::dependents(risk_factor_id_t id) const
+    {
+        MYASSERT(id + 1 < m_trade_offsets.size(), "Invalid risk factor id " << id);
+        return std::vector<size_t>(m_trades.begin() + m_trade_offsets[id], m_trades.begin() + m_trade_offsets[id + 1]);
+    }
+
+} // namespace minirisk
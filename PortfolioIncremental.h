@@ -0,0 +1,73 @@
+#pragma once
+
+#include "PortfolioUtils.h"
+
+#include <string>
+#include <vector>
+
+namespace minirisk
+{
+
+// Portfolio prices kept up to date incrementally as the market moves.
+//
+// The first pricing records, for each trade, the risk factors it reads through the market
+// (directly or via the curves it uses, see Market::record_reads). When some risk factors
+// change, only the trades depending on them are repriced and the total is adjusted by the
+// difference, so a tick touching a small part of the book costs a small part of a full run.
+// The dependencies of the repriced trades are recorded again, so a trade which failed before
+// reading all its inputs is repriced as well when any of the inputs it reads later changes.
+struct incremental_pricer_t
+{
+    // price all the trades, recording their dependencies
+    incremental_pricer_t(const std::vector<ppricer_t> &pricers, Market &mkt);
+
+    // same as above, pricing on the threads of the pool, which is also used by the updates
+    incremental_pricer_t(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool);
+
+    // Reprice the trades depending on any of the changed risk factors, whose new values must
+    // already be in the market (e.g. the result of Market::refresh). Returns the number of
+    // trades repriced.
+    size_t update(const std::vector<risk_factor_id_t> &changed);
+
+    // move the market to the latest market data snapshot and reprice the trades affected
+    size_t refresh() { return update(m_mkt.refresh()); }
+
+    const portfolio_values_t &prices() const { return m_prices; }
+
+    // sum of the prices of the trades which could be priced
+    double total() const { return m_total; }
+
+    // number of trades which could not be priced
+    size_t n_errors() const { return m_n_errors; }
+
+    // risk factors a trade depends on, sorted by id
+    std::vector<risk_factor_id_t> dependencies(size_t trade) const;
+
+    // trades depending on a risk factor, by increasing position
+    std::vector<size_t> dependents(risk_factor_id_t id) const;
+
+private:
+    void price_all();
+    void reprice(const std::vector<size_t> &trades);
+
+    // build the dependency graph from the risk factors of each trade, sorted by id
+    void build_graph(const std::vector<std::vector<risk_factor_id_t>> &deps);
+
+    const std::vector<ppricer_t> &m_pricers;
+    Market &m_mkt;
+    ThreadPool *m_pool;
+
+    portfolio_values_t m_prices;
+    double m_total;
+    size_t m_n_errors;
+
+    // Dependency graph, in compressed sparse row form in both directions:
+    // the risk factors of trade i are m_rf_ids[m_rf_offsets[i] .. m_rf_offsets[i + 1]), and
+    // the trades depending on risk factor id are m_trades[m_trade_offsets[id] .. m_trade_offsets[id + 1])
+    std::vector<size_t> m_rf_offsets;
+    std::vector<risk_factor_id_t> m_rf_ids;
+    std::vector<size_t> m_trade_offsets;
+    std::vector<size_t> m_trades;
+};
+
+} // namespace minirisk
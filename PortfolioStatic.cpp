@@ -0,0 +1,73 @@
+#include "PortfolioStatic.h"
+#include "PortfolioBinary.h"
+
+#include <limits>
+
+namespace minirisk
+{
+
+    static_portfolio_t::static_portfolio_t(const portfolio_t &portfolio)
+    {
+        m_pricers.reserve(portfolio.size());
+        for (const auto &pt : portfolio)
+            push_back(*pt);
+    }
+
+    void static_portfolio_t::push_back(const ITrade &trade)
+    {
+        if (!trade_types_t::append_pricer(trade, m_pricers))
+            THROW("Unknown trade type: " << trade.id());
+    }
+
+    void load_portfolio(const std::string &filename, static_portfolio_t &portfolio)
+    {
+        portfolio = static_portfolio_t();
+        if (is_binary_portfolio(filename))
+        {
+            for (const auto &pt : mapped_portfolio_t(filename).trades())
+                portfolio.push_back(*pt);
+            return;
+        }
+
+        my_ifstream is(filename);
+        while (is.read_line())
+        {
+            guid_t id;
+            is >> id;
+            if (!trade_types_t::load_pricer(id, is, portfolio.m_pricers))
+                THROW("Unknown trade type: " << id);
+        }
+    }
+
+    // price portfolio[begin, end) storing the results in the corresponding slots of prices
+    static void price_range(const static_portfolio_t &portfolio, Market &mkt, portfolio_values_t &prices, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            try
+            {
+                prices[i].first = trade_types_t::price(portfolio[i], mkt);
+            }
+            catch (const std::exception &e)
+            {
+                prices[i] = std::make_pair(std::numeric_limits<double>::quiet_NaN(), e.what());
+            }
+        }
+    }
+
+    portfolio_values_t compute_prices(const static_portfolio_t &portfolio, Market &mkt)
+    {
+        portfolio_values_t prices(portfolio.size());
+        price_range(portfolio, mkt, prices, 0, portfolio.size());
+        return prices;
+    }
+
+    portfolio_values_t compute_prices(const static_portfolio_t &portfolio, Market &mkt, ThreadPool &pool)
+    {
+        portfolio_values_t prices(portfolio.size());
+        pool.parallel_for(portfolio.size(), pool.default_grain(portfolio.size()), [&](size_t begin, size_t end)
+                          { price_range(portfolio, mkt, prices, begin, end); });
+        return prices;
+    }
+
+} // namespace minirisk
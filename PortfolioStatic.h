@@ -0,0 +1,48 @@
+#pragma once
+
+#include "PortfolioUtils.h"
+#include "TradeTypes.h"
+
+#include <vector>
+
+namespace minirisk
+{
+
+// Portfolio priced without virtual calls nor a heap allocated pricer per trade.
+//
+// The pricer of every trade is built once and stored by value in a variant of the pricers of
+// the types registered in trade_types_t, contiguously in portfolio order. Pricing visits the
+// variants, so each call is dispatched on the index of the variant and bound at compile time.
+struct static_portfolio_t
+{
+    static_portfolio_t() {}
+
+    // build the pricers of the trades, which must all be of a registered type
+    explicit static_portfolio_t(const portfolio_t &portfolio);
+
+    size_t size() const { return m_pricers.size(); }
+
+    // append the pricer of a trade after the existing ones
+    void push_back(const ITrade &trade);
+
+    const trade_types_t::pricer_variant_t &operator[](size_t i) const { return m_pricers[i]; }
+
+private:
+    friend void load_portfolio(const std::string &filename, static_portfolio_t &portfolio);
+
+    std::vector<trade_types_t::pricer_variant_t> m_pricers;
+};
+
+// Fill the portfolio with the pricers of the trades in the file. Both the text and the binary
+// (see PortfolioBinary.h) formats are accepted, text files being read without creating a
+// trade object for each line.
+void load_portfolio(const std::string &filename, static_portfolio_t &portfolio);
+
+// Price all the trades, with the same result as compute_prices applied to the pricers
+// of the same portfolio
+portfolio_values_t compute_prices(const static_portfolio_t &portfolio, Market &mkt);
+
+// Same as above, spreading the trades over the threads of the pool
+portfolio_values_t compute_prices(const static_portfolio_t &portfolio, Market &mkt, ThreadPool &pool);
+
+} // namespace minirisk
@@ -0,0 +1,95 @@
+#include "PortfolioStream.h"
+#include "PortfolioBinary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+namespace minirisk
+{
+
+    portfolio_reader_t::portfolio_reader_t(const std::string &filename)
+        : m_position(0)
+    {
+        if (is_binary_portfolio(filename))
+            m_binary.reset(new mapped_portfolio_t(filename));
+        else
+            m_text.reset(new my_ifstream(filename));
+    }
+
+    portfolio_reader_t::~portfolio_reader_t()
+    {
+    }
+
+    bool portfolio_reader_t::read(portfolio_t &chunk, size_t max_trades)
+    {
+        MYASSERT(max_trades > 0, "The chunk size must be positive");
+        chunk.clear();
+        if (m_binary)
+        {
+            size_t end = std::min(m_position + max_trades, m_binary->size());
+            chunk = m_binary->trades(m_position, end);
+        }
+        else
+        {
+            while (chunk.size() < max_trades && m_text->read_line())
+                chunk.push_back(load_trade(*m_text));
+        }
+        m_position += chunk.size();
+        return !chunk.empty();
+    }
+
+    // price the chunk of trades starting at position offset of the portfolio and add it to the summary
+    static void add_chunk(const portfolio_t &chunk, size_t offset, Market &mkt, ThreadPool *pool, size_t max_errors, portfolio_summary_t &summary)
+    {
+        std::vector<ppricer_t> pricers(get_pricers(chunk));
+        portfolio_values_t prices = pool ? compute_prices(pricers, mkt, *pool) : compute_prices(pricers, mkt);
+
+        for (size_t i = 0; i < prices.size(); ++i)
+        {
+            if (std::isnan(prices[i].first))
+            {
+                if (summary.errors.size() < max_errors)
+                    summary.errors.emplace_back(offset + i, prices[i].second);
+                ++summary.n_errors;
+            }
+            else
+            {
+                summary.total += prices[i].first;
+            }
+        }
+        summary.n_trades += prices.size();
+    }
+
+    static portfolio_summary_t stream_prices(const std::string &filename, Market &mkt, size_t chunk_size, ThreadPool *pool, size_t max_errors)
+    {
+        portfolio_summary_t summary;
+        portfolio_reader_t reader(filename);
+
+        portfolio_t chunk, next;
+        bool more = reader.read(chunk, chunk_size);
+        while (more)
+        {
+            // read the next chunk in the background while pricing the current one
+            size_t offset = reader.position() - chunk.size();
+            std::future<bool> pending = std::async(std::launch::async, [&]()
+                                                   { return reader.read(next, chunk_size); });
+            add_chunk(chunk, offset, mkt, pool, max_errors, summary);
+            more = pending.get();
+            std::swap(chunk, next);
+        }
+
+        return summary;
+    }
+
+    portfolio_summary_t price_portfolio_stream(const std::string &filename, Market &mkt, size_t chunk_size, size_t max_errors)
+    {
+        return stream_prices(filename, mkt, chunk_size, nullptr, max_errors);
+    }
+
+    portfolio_summary_t price_portfolio_stream(const std::string &filename, Market &mkt, size_t chunk_size, ThreadPool &pool, size_t max_errors)
+    {
+        return stream_prices(filename, mkt, chunk_size, &pool, max_errors);
+    }
+
+} // namespace minirisk
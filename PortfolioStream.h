@@ -0,0 +1,53 @@
+#pragma once
+
+#include "PortfolioUtils.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace minirisk
+{
+
+struct mapped_portfolio_t;
+
+// Read a portfolio file sequentially, a chunk of trades at a time, so that only
+// the current chunk is held in memory. Both the text and the binary formats are accepted.
+struct portfolio_reader_t
+{
+    explicit portfolio_reader_t(const std::string &filename);
+    ~portfolio_reader_t();
+
+    // Replace the content of chunk with the next trades of the file, at most max_trades.
+    // Returns false, with chunk empty, once the end of the file has been reached.
+    bool read(portfolio_t &chunk, size_t max_trades);
+
+    // position in the portfolio of the next trade to be read
+    size_t position() const { return m_position; }
+
+private:
+    std::unique_ptr<my_ifstream> m_text;
+    std::unique_ptr<mapped_portfolio_t> m_binary;
+    size_t m_position;
+};
+
+// Totals of a portfolio priced in a streaming fashion
+struct portfolio_summary_t
+{
+    size_t n_trades = 0;
+    double total = 0.0;  // sum of the prices of the trades which could be priced
+    size_t n_errors = 0; // number of trades which could not be priced
+    std::vector<std::pair<size_t, std::string>> errors; // (position, message), for the first max_errors failed trades
+};
+
+// Price the portfolio in the file without loading it whole: trades are read in chunks of
+// chunk_size, each chunk is priced and aggregated into the summary before being discarded.
+// The next chunk is read while the current one is priced, so at most two chunks are held in
+// memory. Trade positions in the summary refer to the whole portfolio.
+portfolio_summary_t price_portfolio_stream(const std::string &filename, Market &mkt, size_t chunk_size, size_t max_errors = 100);
+
+// Same as above, pricing each chunk on the threads of the pool
+portfolio_summary_t price_portfolio_stream(const std::string &filename, Market &mkt, size_t chunk_size, ThreadPool &pool, size_t max_errors = 100);
+
+} // namespace minirisk
@@ -1,10 +1,17 @@
 #include "PortfolioUtils.h"
+#include "PortfolioBinary.h"
+#include "PortfolioIncremental.h"
 #include "Global.h"
-#include "TradePayment.h"
-
+#include "TradeTypes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
 #include <map>
 #include <numeric>
-#include <regex>
 #include <vector>
 
 namespace minirisk
@@ -25,24 +32,34 @@ namespace minirisk
         return pricers;
     }
 
-    portfolio_values_t compute_prices(const std::vector<ppricer_t> &pricers, Market &mkt)
+    // price pricers[begin, end) storing the results in the corresponding slots of prices
+    static void price_range(const std::vector<ppricer_t> &pricers, Market &mkt, portfolio_values_t &prices, size_t begin, size_t end)
     {
-        portfolio_values_t prices;
-        prices.reserve(pricers.size());
-
-        for (const auto &pp : pricers)
+        for (size_t i = begin; i < end; ++i)
         {
             try
             {
-                double price = pp->price(mkt);
-                prices.emplace_back(price, "");
+                prices[i].first = pricers[i]->price(mkt);
             }
             catch (const std::exception &e)
             {
-                prices.emplace_back(std::numeric_limits<double>::quiet_NaN(), e.what());
+                prices[i] = std::make_pair(std::numeric_limits<double>::quiet_NaN(), e.what());
             }
         }
+    }
 
+    portfolio_values_t compute_prices(const std::vector<ppricer_t> &pricers, Market &mkt)
+    {
+        portfolio_values_t prices(pricers.size());
+        price_range(pricers, mkt, prices, 0, pricers.size());
+        return prices;
+    }
+
+    portfolio_values_t compute_prices(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool)
+    {
+        portfolio_values_t prices(pricers.size());
+        pool.parallel_for(pricers.size(), pool.default_grain(pricers.size()), [&](size_t begin, size_t end)
+                          { price_range(pricers, mkt, prices, begin, end); });
         return prices;
     }
 
@@ -66,117 +83,149 @@ namespace minirisk
         return std::make_pair(total, errors);
     }
 
-    std::vector<std::pair<string, portfolio_values_t>> compute_pv01_parallel(const std::vector<ppricer_t> &pricers, Market &mkt)
-    {
-        std::vector<std::pair<string, portfolio_values_t>> pv01; // PV01 per trade
-        std::map<string, Market::vec_risk_factor_t> base_map;
+    // A PV01 scenario is a named set of risk factors bumped together
+    typedef std::vector<std::pair<string, Market::vec_risk_factor_t>> pv01_scenarios_t;
 
-        const double bump_size = 0.01 / 100;
+    // copy of the risk factors shifted by bump_size
+    static Market::vec_risk_factor_t bump_risk_factors(const Market::vec_risk_factor_t &base, double bump_size)
+    {
+        Market::vec_risk_factor_t bumped(base);
+        for (auto &d : bumped)
+            d.second += bump_size;
+        return bumped;
+    }
 
-        // Filter risk factors related to IR using a regex pattern
-        auto base = mkt.get_risk_factors(ir_rate_prefix + "\\d+[DWMY]\\.[A-Z]{3}");
+    // Sensitivity of each trade to a parallel shift of the risk factors in base, estimated
+    // via central finite differences. Each bumped market is an overlay of mkt, sharing the
+    // curves which do not depend on the bumped risk factors, so that several scenarios can
+    // be priced at the same time without copying the market.
+    // Only the trades whose footprint (the risk factors read in the base pricing) contains a
+    // bumped risk factor are repriced: the price of the others cannot move, so their PV01 is
+    // exactly zero, or the error of the base pricing if they failed.
+    static portfolio_values_t pv01_scenario(const std::vector<ppricer_t> &all_pricers, Market &mkt, const Market::vec_risk_factor_t &base, const incremental_pricer_t &footprints, ThreadPool *pool)
+    {
+        const double bump_size = 0.01 / 100; // 1 basis point
 
-        for (auto &b : base)
+        std::vector<size_t> trades;
+        for (const auto &d : base)
         {
-            base_map[ir_rate_prefix + b.first.substr(b.first.length() - 3, 3)].push_back(b);
+            std::vector<size_t> dependents = footprints.dependents(mkt.risk_factor_id(d.first));
+            trades.insert(trades.end(), dependents.begin(), dependents.end());
         }
+        std::sort(trades.begin(), trades.end());
+        trades.erase(std::unique(trades.begin(), trades.end()), trades.end());
 
-        // Make a local copy of the Market object, because we will modify it applying bumps
-        Market tmpmkt(mkt);
+        std::vector<ppricer_t> pricers(trades.size());
+        std::transform(trades.begin(), trades.end(), pricers.begin(), [&all_pricers](size_t i)
+                       { return all_pricers[i]; });
 
-        // Compute prices for perturbed markets and aggregate results
-        pv01.reserve(base_map.size());
-        for (const auto &bm : base_map)
+        portfolio_values_t pv_up, pv_dn;
+
+        // Bump down and price
         {
-            std::vector<std::pair<string, double>> bumped;
-            pv01.push_back(std::make_pair(bm.first, portfolio_values_t(pricers.size())));
-            portfolio_values_t pv_up, pv_dn;
+            Market mkt_dn(mkt, bump_risk_factors(base, -bump_size));
+            pv_dn = pool ? compute_prices(pricers, mkt_dn, *pool) : compute_prices(pricers, mkt_dn);
+        }
 
-            // Bump down and price
-            for (size_t i = 0; i < bm.second.size(); ++i)
-            {
-                bumped.push_back(bm.second[i]);
-                bumped[i].second = bm.second[i].second - bump_size;
-            }
-            tmpmkt.set_risk_factors(bumped);
-            pv_dn = compute_prices(pricers, tmpmkt);
+        // Bump up and price
+        {
+            Market mkt_up(mkt, bump_risk_factors(base, bump_size));
+            pv_up = pool ? compute_prices(pricers, mkt_up, *pool) : compute_prices(pricers, mkt_up);
+        }
 
-            // Bump up and price
-            for (size_t i = 0; i < bm.second.size(); ++i)
-            {
-                bumped[i].second = bm.second[i].second + bump_size;
-            }
-            tmpmkt.set_risk_factors(bumped);
-            pv_up = compute_prices(pricers, tmpmkt);
+        // Compute estimator of the derivative via central finite differences,
+        // trades failing to price in either scenario keep their error message
+        double dr = 2.0 * bump_size;
+        portfolio_values_t pv01(pricers.size());
+        std::transform(pv_up.begin(), pv_up.end(), pv_dn.begin(), pv01.begin(),
+                       [dr](const auto &hi, const auto &lo) -> portfolio_values_t::value_type
+                       {
+                           if (std::isnan(hi.first))
+                               return hi;
+                           else if (std::isnan(lo.first))
+                               return lo;
+                           else
+                               return std::make_pair((hi.first - lo.first) / dr, string());
+                       });
+
+        // scatter into the positions of the whole portfolio
+        portfolio_values_t result(all_pricers.size());
+        for (size_t i = 0; i < result.size(); ++i)
+            if (std::isnan(footprints.prices()[i].first))
+                result[i] = footprints.prices()[i];
+        for (size_t k = 0; k < trades.size(); ++k)
+            result[trades[k]] = std::move(pv01[k]);
+        return result;
+    }
 
-            // Restore original market state for next iteration
-            for (size_t i = 0; i < bm.second.size(); ++i)
-            {
-                bumped[i].second = bm.second[i].second;
-            }
-            tmpmkt.set_risk_factors(bumped);
-
-            // Compute estimator of the derivative via central finite differences
-            double dr = 2.0 * bump_size;
-            std::transform(pv_up.begin(), pv_up.end(), pv_dn.begin(), pv01.back().second.begin(),
-                           [dr](double hi, double lo) -> double
-                           {
-                               if (std::isnan(hi))
-                                   return std::numeric_limits<double>::quiet_NaN();
-                               else if (std::isnan(lo))
-                                   return std::numeric_limits<double>::quiet_NaN();
-                               else
-                                   return (hi - lo) / dr;
-                           });
-        }
+    // Run all scenarios, concurrently if a pool is provided. Trades are priced in parallel
+    // within each scenario as well, so the pool stays busy even with few scenarios.
+    // A first pricing in the base market records the footprint of each trade.
+    static std::vector<std::pair<string, portfolio_values_t>> compute_pv01(const std::vector<ppricer_t> &pricers, Market &mkt, const pv01_scenarios_t &scenarios, ThreadPool *pool)
+    {
+        std::unique_ptr<incremental_pricer_t> footprints(pool ? new incremental_pricer_t(pricers, mkt, *pool) : new incremental_pricer_t(pricers, mkt));
 
+        std::vector<std::pair<string, portfolio_values_t>> pv01(scenarios.size()); // PV01 per trade
+        auto run = [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+                pv01[i] = std::make_pair(scenarios[i].first, pv01_scenario(pricers, mkt, scenarios[i].second, *footprints, pool));
+        };
+        if (pool)
+            pool->parallel_for(scenarios.size(), 1, run);
+        else
+            run(0, scenarios.size());
         return pv01;
     }
 
-    std::vector<std::pair<string, portfolio_values_t>> compute_pv01_bucketed(const std::vector<ppricer_t> &pricers, Market &mkt)
+    // one scenario per currency, bumping all the points of its yield curve
+    static pv01_scenarios_t pv01_parallel_scenarios(const Market &mkt)
     {
-        const double bump_size = 0.01 / 100; // 1 basis point
+        std::map<string, Market::vec_risk_factor_t> base_map;
 
-        std::vector<std::pair<string, portfolio_values_t>> pv01; // PV01 per trade
+        // Yield curve points, from the risk factor index
+        auto base = mkt.get_risk_factors(mkt.symbols().ir_pillars());
 
-        // Filter risk factors related to IR
-        auto base = mkt.get_risk_factors(ir_rate_prefix + "\\d+[DWMY]\\.[A-Z]{3}");
+        for (auto &b : base)
+        {
+            base_map[ir_rate_prefix + b.first.substr(b.first.length() - 3, 3)].push_back(b);
+        }
 
-        // Make a local copy of the Market object
-        Market tmpmkt(mkt);
+        return pv01_scenarios_t(base_map.begin(), base_map.end());
+    }
 
-        // Compute prices for perturbed markets
-        pv01.reserve(base.size());
+    // one scenario per yield curve point
+    static pv01_scenarios_t pv01_bucketed_scenarios(const Market &mkt)
+    {
+        pv01_scenarios_t scenarios;
+
+        // Yield curve points, from the risk factor index
+        auto base = mkt.get_risk_factors(mkt.symbols().ir_pillars());
+
+        scenarios.reserve(base.size());
         for (const auto &d : base)
-        {
-            portfolio_values_t pv_up, pv_dn;
-            std::vector<std::pair<string, double>> bumped(1, d);
-            pv01.push_back(std::make_pair(d.first, portfolio_values_t(pricers.size())));
-
-            // Bump down and price
-            bumped[0].second -= bump_size;
-            tmpmkt.set_risk_factors(bumped);
-            pv_dn = compute_prices(pricers, tmpmkt);
-
-            // Bump up and price
-            bumped[0].second += 2 * bump_size; // Bump up
-            tmpmkt.set_risk_factors(bumped);
-            pv_up = compute_prices(pricers, tmpmkt);
-
-            // Restore original market state
-            bumped[0].second = d.second;
-            tmpmkt.set_risk_factors(bumped);
-
-            // Compute central difference
-            double dr = 2.0 * bump_size;
-            std::transform(pv_up.begin(), pv_up.end(), pv_dn.begin(), pv01.back().second.begin(),
-                           [dr](double hi, double lo)
-                           {
-                               return (hi - lo) / dr;
-                           });
-        }
+            scenarios.emplace_back(d.first, Market::vec_risk_factor_t(1, d));
+        return scenarios;
+    }
 
-        return pv01;
+    std::vector<std::pair<string, portfolio_values_t>> compute_pv01_parallel(const std::vector<ppricer_t> &pricers, Market &mkt)
+    {
+        return compute_pv01(pricers, mkt, pv01_parallel_scenarios(mkt), nullptr);
+    }
+
+    std::vector<std::pair<string, portfolio_values_t>> compute_pv01_parallel(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool)
+    {
+        return compute_pv01(pricers, mkt, pv01_parallel_scenarios(mkt), &pool);
+    }
+
+    std::vector<std::pair<string, portfolio_values_t>> compute_pv01_bucketed(const std::vector<ppricer_t> &pricers, Market &mkt)
+    {
+        return compute_pv01(pricers, mkt, pv01_bucketed_scenarios(mkt), nullptr);
+    }
+
+    std::vector<std::pair<string, portfolio_values_t>> compute_pv01_bucketed(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool)
+    {
+        return compute_pv01(pricers, mkt, pv01_bucketed_scenarios(mkt), &pool);
     }
 
     ptrade_t load_trade(my_ifstream &is)
@@ -188,9 +237,8 @@ namespace minirisk
         guid_t id;
         is >> id;
 
-        if (id == TradePayment::m_id)
-            p.reset(new TradePayment);
-        else
+        p = trade_types_t::make_trade(id);
+        if (!p)
             THROW("Unknown trade type: " << id);
 
         p->load(is);
@@ -212,6 +260,9 @@ namespace minirisk
 
     std::vector<ptrade_t> load_portfolio(const string &filename)
     {
+        if (is_binary_portfolio(filename))
+            return mapped_portfolio_t(filename).trades();
+
         std::vector<ptrade_t> portfolio;
 
         // Test reloading the portfolio
@@ -222,6 +273,97 @@ namespace minirisk
         return portfolio;
     }
 
+    // start of the first line beginning at or after offset pos of the file
+    static size_t next_line_start(std::ifstream &is, size_t pos, size_t file_size)
+    {
+        if (pos == 0)
+            return 0;
+        size_t cur = pos - 1; // pos is a line start if the previous character is an end of line
+        is.clear();
+        is.seekg(cur);
+        char buf[4096];
+        while (is)
+        {
+            is.read(buf, sizeof(buf));
+            size_t n = static_cast<size_t>(is.gcount());
+            const char *eol = static_cast<const char *>(std::memchr(buf, '\n', n));
+            if (eol)
+                return cur + (eol - buf) + 1;
+            cur += n;
+        }
+        return file_size;
+    }
+
+    std::vector<size_t> portfolio_shards(const string &filename, size_t max_shards)
+    {
+        std::ifstream is(filename, std::ios::binary | std::ios::ate);
+        MYASSERT(!is.fail(), "Could not open file " << filename);
+        const size_t file_size = static_cast<size_t>(is.tellg());
+
+        // not so small shards that opening the file dominates
+        const size_t n_shards = std::max<size_t>(1, std::min<size_t>(max_shards, file_size / min_shard_size));
+        std::vector<size_t> bounds(n_shards + 1, 0);
+        bounds[n_shards] = file_size;
+        for (size_t i = 1; i < n_shards; ++i)
+            bounds[i] = std::max(bounds[i - 1], next_line_start(is, i * (file_size / n_shards), file_size));
+        return bounds;
+    }
+
+    std::vector<ptrade_t> load_portfolio(const string &filename, ThreadPool &pool)
+    {
+        if (is_binary_portfolio(filename))
+        {
+            mapped_portfolio_t mapped(filename);
+            portfolio_t portfolio(mapped.size());
+            pool.parallel_for(portfolio.size(), pool.default_grain(portfolio.size()), [&](size_t begin, size_t end)
+                              {
+                portfolio_t part = mapped.trades(begin, end);
+                std::move(part.begin(), part.end(), portfolio.begin() + begin); });
+            return portfolio;
+        }
+
+        // a few shards per thread to balance the load
+        const std::vector<size_t> bounds = portfolio_shards(filename, 4 * pool.size());
+        const size_t n_shards = bounds.size() - 1;
+
+        struct shard_t
+        {
+            portfolio_t trades;
+            bool complete = false; // false if the shard stopped at an empty line
+            std::exception_ptr error;
+        };
+        std::vector<shard_t> shards(n_shards);
+        pool.parallel_for(n_shards, 1, [&](size_t begin, size_t end)
+                          {
+            for (size_t i = begin; i < end; ++i)
+            {
+                try
+                {
+                    my_ifstream shard_is(filename, bounds[i], bounds[i + 1]);
+                    while (shard_is.read_line())
+                        shards[i].trades.push_back(load_trade(shard_is));
+                    shards[i].complete = shard_is.eof();
+                }
+                catch (...)
+                {
+                    shards[i].error = std::current_exception();
+                }
+            } });
+
+        // Merge in file order. As the sequential loader, stop at the first empty line
+        // and report the first error, ignoring whatever follows.
+        std::vector<ptrade_t> portfolio;
+        for (shard_t &shard : shards)
+        {
+            if (shard.error)
+                std::rethrow_exception(shard.error);
+            portfolio.insert(portfolio.end(), std::make_move_iterator(shard.trades.begin()), std::make_move_iterator(shard.trades.end()));
+            if (!shard.complete)
+                break;
+        }
+        return portfolio;
+    }
+
     void print_price_vector(const string &name, const portfolio_values_t &values)
     {
         std::cout
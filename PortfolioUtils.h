@@ -2,6 +2,7 @@
 
 #include "Trade.h"
 #include "Market.h"
+#include "ThreadPool.h"
 #include <vector>
 #include <string>
 #include <utility>
@@ -19,6 +20,10 @@ void print_portfolio(const portfolio_t &portfolio);
 std::vector<ppricer_t> get_pricers(const portfolio_t &portfolio);
 portfolio_values_t compute_prices(const std::vector<ppricer_t> &pricers, Market &mkt);
 
+// Same as above, spreading the pricers over the threads of the pool.
+// Results are returned in the same order as the pricers.
+portfolio_values_t compute_prices(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool);
+
 // Compute total portfolio value and return the total and errors (if any)
 std::pair<double, std::vector<std::pair<size_t, std::string>>> portfolio_total(const portfolio_values_t &values);
 
@@ -28,11 +33,26 @@ std::vector<std::pair<std::string, portfolio_values_t>> compute_pv01_parallel(co
 // Compute PV01 sensitivities for a bucketed shift
 std::vector<std::pair<std::string, portfolio_values_t>> compute_pv01_bucketed(const std::vector<ppricer_t> &pricers, Market &mkt);
 
-// Loading and saving portfolio functions
+// Same as above, pricing the bump scenarios concurrently on the threads of the pool
+std::vector<std::pair<std::string, portfolio_values_t>> compute_pv01_parallel(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool);
+std::vector<std::pair<std::string, portfolio_values_t>> compute_pv01_bucketed(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool &pool);
+
+// Loading and saving portfolio functions.
+// load_portfolio accepts both the text and the binary (see PortfolioBinary.h) formats.
 ptrade_t load_trade(my_ifstream &is);
 void save_portfolio(const std::string &filename, const std::vector<ptrade_t> &portfolio);
 std::vector<ptrade_t> load_portfolio(const std::string &filename);
 
+// Same as above, parsing shards of the file concurrently on the threads of the pool.
+// The trades are returned in file order, as by the sequential loader.
+std::vector<ptrade_t> load_portfolio(const std::string &filename, ThreadPool &pool);
+
+// Split a text portfolio file in at most max_shards shards of whole lines of at least
+// min_shard_size bytes (a single shard for smaller files), as done by the parallel loader.
+// Returns the offsets of the shards: shard i is [bounds[i], bounds[i + 1]).
+const size_t min_shard_size = 1 << 20;
+std::vector<size_t> portfolio_shards(const std::string &filename, size_t max_shards);
+
 // Utility function to print portfolio values
 void print_price_vector(const std::string &name, const portfolio_values_t &values);
 
@@ -0,0 +1,39 @@
+#include "PricerPayment.h"
+
+namespace minirisk {
+
+namespace {
+
+// the market seen through the interface of PricerPayment::value
+struct market_view_t
+{
+    Market& m_mkt;
+
+    double df(const string& curve_name, const Date& t)
+    {
+        return m_mkt.discount_curve(curve_name).df(t);
+    }
+
+    double get_fx_spot(const string& name)
+    {
+        return m_mkt.get_fx_spot(name);
+    }
+};
+
+} // namespace
+
+PricerPayment::PricerPayment(const TradePayment& trd)
+    : m_amt(trd.quantity())
+    , m_dt(trd.delivery_date())
+    , m_ir_curve(ir_curve_discount_name(trd.ccy()))
+    , m_fx_ccy(trd.ccy() == "USD" ? "" : fx_spot_name(trd.ccy(), "USD"))
+{
+}
+
+double PricerPayment::price(Market& mkt) const
+{
+    market_view_t view{mkt};
+    return value(view);
+}
+
+} // namespace minirisk
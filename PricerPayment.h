@@ -0,0 +1,36 @@
+#pragma once
+
+#include "IPricer.h"
+#include "TradePayment.h"
+
+namespace minirisk {
+
+struct PricerPayment : IPricer
+{
+    PricerPayment(const TradePayment& trd);
+
+    virtual double price(Market& mkt) const;
+
+    // The pricing formula, shared by price() and the adjoint pricer (see RiskAAD.cpp).
+    // MarketView provides df(curve name, date), whose type (double or AReal) is the type
+    // of the result, and get_fx_spot(name).
+    template <typename MarketView>
+    auto value(MarketView& mkt) const
+    {
+        auto df = mkt.df(m_ir_curve, m_dt); // throws if m_dt is before today or beyond the curve
+
+        // This PV is expressed in the currency of the payment. It must be converted in USD.
+        if (!m_fx_ccy.empty())
+            df = df * mkt.get_fx_spot(m_fx_ccy);
+
+        return m_amt * df;
+    }
+
+private:
+    double m_amt;
+    Date m_dt;
+    string m_ir_curve;
+    string m_fx_ccy; // empty for payments in USD
+};
+
+} // namespace minirisk
@@ -0,0 +1,108 @@
+#include "RiskAAD.h"
+#include "AAD.h"
+#include "Global.h"
+#include "PricerPayment.h"
+
+#include <limits>
+#include <map>
+
+namespace minirisk
+{
+
+    namespace
+    {
+        // View of the market where the yield curve points are independent variables on a tape
+        struct AadMarket
+        {
+            AadMarket(Market &mkt, Tape &tape, const Market::vec_risk_factor_t &factors)
+                : m_mkt(mkt), m_tape(tape)
+            {
+                for (const auto &f : factors)
+                {
+                    risk_factor_id_t id = mkt.risk_factor_id(f.first);
+                    if (m_inputs.size() <= id)
+                        m_inputs.resize(id + 1);
+                    m_inputs[id] = tape.input(f.second);
+                }
+            }
+
+            AReal df(const string &curve_name, const Date &t)
+            {
+                auto iter = m_curves.find(curve_name);
+                if (iter == m_curves.end())
+                {
+                    ptr_disc_curve_t curve = m_mkt.get_discount_curve(curve_name);
+                    std::vector<AReal> rates;
+                    for (size_t k = 0; k < curve->pillar_ids().size(); ++k)
+                        rates.push_back(input(curve->pillar_ids()[k], curve->pillar_names()[k]));
+                    iter = m_curves.emplace(curve_name, std::make_pair(curve, rates)).first;
+                }
+                // the discount factor is recorded as a single node, using the analytic
+                // sensitivities to the pillars rather than taping the interpolation formula
+                df_jacobian_t jac = iter->second.first->df_jacobian(t);
+                const std::vector<AReal> &rates = iter->second.second;
+                return m_tape.record(jac.df, &rates[jac.pillar[0]], jac.ddf_dr[0], &rates[jac.pillar[1]], jac.ddf_dr[1]);
+            }
+
+            // only IR sensitivities are computed, so fx spots enter the computation as constants
+            double get_fx_spot(const string &name)
+            {
+                return m_mkt.get_fx_spot(name);
+            }
+
+        private:
+            const AReal &input(risk_factor_id_t id, const string &name) const
+            {
+                MYASSERT(id < m_inputs.size() && m_inputs[id].m_tape, "Risk factor not found " << name);
+                return m_inputs[id];
+            }
+
+            Market &m_mkt;
+            Tape &m_tape;
+            std::vector<AReal> m_inputs; // indexed by risk factor id, constants for the ids which are not inputs
+            std::map<string, std::pair<ptr_disc_curve_t, std::vector<AReal>>> m_curves;
+        };
+
+        // the pricers are run on the adjoint market with the same formula as on the market
+        AReal price(const ITrade &trd, AadMarket &mkt)
+        {
+            if (trd.id() == TradePayment::m_id)
+                return PricerPayment(static_cast<const TradePayment &>(trd)).value(mkt);
+            THROW("Adjoint pricing is not available for trade type " << trd.idname());
+        }
+    }
+
+    std::vector<std::pair<string, portfolio_values_t>> compute_pv01_aad(const portfolio_t &portfolio, Market &mkt)
+    {
+        // Independent variables are created first, so that the tape index of the i-th risk factor is i
+        auto factors = mkt.fetch_risk_factors(mkt.symbols().ir_pillars());
+        Tape tape;
+        AadMarket aadmkt(mkt, tape, factors);
+        const size_t start = tape.size();
+
+        std::vector<std::pair<string, portfolio_values_t>> pv01; // PV01 per trade
+        pv01.reserve(factors.size());
+        for (const auto &f : factors)
+            pv01.emplace_back(f.first, portfolio_values_t(portfolio.size(), std::make_pair(0.0, string())));
+
+        for (size_t i = 0; i < portfolio.size(); ++i)
+        {
+            // each trade reuses the tape after the independent variables
+            tape.rewind(start);
+            try
+            {
+                AReal pv = price(*portfolio[i], aadmkt);
+                tape.backward(pv, start, [&pv01, i](size_t input, double adjoint)
+                              { pv01[input].second[i].first = adjoint; });
+            }
+            catch (const std::exception &e)
+            {
+                for (auto &p : pv01)
+                    p.second[i] = std::make_pair(std::numeric_limits<double>::quiet_NaN(), e.what());
+            }
+        }
+
+        return pv01;
+    }
+
+} // namespace minirisk
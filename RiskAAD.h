@@ -0,0 +1,18 @@
+#pragma once
+
+#include "PortfolioUtils.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace minirisk
+{
+
+// Compute the sensitivity of each trade to every yield curve point IR.<tenor>.<ccy> via
+// adjoint algorithmic differentiation: one forward and one backward sweep per trade, whose
+// cost does not depend on the number of risk factors. The result has the same layout as
+// compute_pv01_bucketed, so the two can be compared.
+std::vector<std::pair<std::string, portfolio_values_t>> compute_pv01_aad(const portfolio_t &portfolio, Market &mkt);
+
+} // namespace minirisk
@@ -0,0 +1,87 @@
+#include "RiskFactors.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace minirisk
+{
+
+    // a currency code is made of 3 upper case letters
+    static bool is_ccy(std::string_view s)
+    {
+        return s.size() == 3 && std::all_of(s.begin(), s.end(), [](char c)
+                                            { return c >= 'A' && c <= 'Z'; });
+    }
+
+    risk_factor_key_t parse_risk_factor(std::string_view name)
+    {
+        risk_factor_key_t key;
+
+        if (name.size() > 4 && name.substr(0, 3) == "IR.")
+        {
+            // IR.<number><unit>.<ccy>
+            std::string_view rest = name.substr(3);
+            size_t dot = rest.find('.');
+            if (dot == std::string_view::npos || dot < 2 || !is_ccy(rest.substr(dot + 1)))
+                return key;
+            std::string_view tenor = rest.substr(0, dot);
+            unsigned n = 0;
+            auto res = std::from_chars(tenor.data(), tenor.data() + tenor.size() - 1, n);
+            if (res.ec != std::errc() || res.ptr != tenor.data() + tenor.size() - 1)
+                return key;
+            switch (tenor.back())
+            {
+            case 'D':
+                key.tenor_days = n;
+                break;
+            case 'W':
+                key.tenor_days = n * 7;
+                break;
+            case 'M':
+                key.tenor_days = n * 30;
+                break;
+            case 'Y':
+                key.tenor_days = n * 365;
+                break;
+            default:
+                return key;
+            }
+            key.kind = risk_factor_kind_t::ir_rate;
+            key.tenor = string(tenor);
+            key.ccy = string(rest.substr(dot + 1));
+        }
+        else if (name.size() == 11 && name.substr(0, 8) == "FX.SPOT." && is_ccy(name.substr(8)))
+        {
+            key.kind = risk_factor_kind_t::fx_spot;
+            key.ccy = string(name.substr(8));
+        }
+
+        return key;
+    }
+
+    risk_factor_table_t::risk_factor_table_t(std::vector<string> &&names)
+        : m_names(std::move(names))
+    {
+        MYASSERT(m_names.size() < invalid_risk_factor_id, "Too many risk factors: " << m_names.size());
+        m_ids.reserve(m_names.size());
+        m_keys.reserve(m_names.size());
+        for (size_t i = 0; i < m_names.size(); ++i)
+        {
+            MYASSERT(i == 0 || m_names[i - 1] < m_names[i], "Risk factor names must be sorted and unique, got " << m_names[i]);
+            risk_factor_id_t id = static_cast<risk_factor_id_t>(i);
+            m_ids.emplace(m_names[i], id);
+            m_keys.push_back(parse_risk_factor(m_names[i]));
+            if (m_keys[i].kind == risk_factor_kind_t::ir_rate)
+            {
+                m_ir_pillars.push_back(id);
+                m_ir_pillars_by_ccy[m_keys[i].ccy].push_back(id);
+            }
+        }
+
+        // curves need their pillars by increasing tenor (ties broken by name, as ids follow names)
+        for (auto &p : m_ir_pillars_by_ccy)
+            std::sort(p.second.begin(), p.second.end(), [this](risk_factor_id_t a, risk_factor_id_t b)
+                      { return std::make_pair(m_keys[a].tenor_days, a) < std::make_pair(m_keys[b].tenor_days, b); });
+    }
+
+} // namespace minirisk
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Global.h"
+#include "Macros.h"
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace minirisk
+{
+
+    // Dense integer identifier of a risk factor name, valid within a risk_factor_table_t
+    typedef uint32_t risk_factor_id_t;
+
+    const risk_factor_id_t invalid_risk_factor_id = std::numeric_limits<risk_factor_id_t>::max();
+
+    enum class risk_factor_kind_t
+    {
+        ir_rate, // IR.<tenor>.<ccy>, a pillar of the yield curve of ccy, e.g. IR.3M.USD
+        fx_spot, // FX.SPOT.<ccy>, value of 1 unit of ccy in USD
+        other
+    };
+
+    // Risk factor name parsed into its components
+    struct risk_factor_key_t
+    {
+        risk_factor_kind_t kind = risk_factor_kind_t::other;
+        string ccy;              // empty for kind other
+        string tenor;            // e.g. "3M", only for kind ir_rate
+        unsigned tenor_days = 0; // tenor converted into days (W = 7, M = 30, Y = 365)
+    };
+
+    // Parse a risk factor name. Names not following any known pattern are of kind other.
+    risk_factor_key_t parse_risk_factor(std::string_view name);
+
+    // Symbol table interning each risk factor name once.
+    // Ids are assigned in name order, so iterating over ids visits names in sorted order.
+    // The table is immutable once built, hence it can be shared between threads without locking.
+    struct risk_factor_table_t
+    {
+        // names must be sorted and unique
+        explicit risk_factor_table_t(std::vector<string> &&names);
+
+        // not copyable, the index refers to the names it owns
+        risk_factor_table_t(const risk_factor_table_t &) = delete;
+        risk_factor_table_t &operator=(const risk_factor_table_t &) = delete;
+
+        size_t size() const { return m_names.size(); }
+
+        const string &name(risk_factor_id_t id) const { return m_names[id]; }
+
+        const risk_factor_key_t &key(risk_factor_id_t id) const { return m_keys[id]; }
+
+        // id of a name, or invalid_risk_factor_id if unknown
+        risk_factor_id_t find(std::string_view name) const
+        {
+            auto iter = m_ids.find(name);
+            return iter != m_ids.end() ? iter->second : invalid_risk_factor_id;
+        }
+
+        // all the yield curve pillars, in name order
+        const std::vector<risk_factor_id_t> &ir_pillars() const { return m_ir_pillars; }
+
+        // the pillars of the yield curve of a currency, by increasing tenor (empty if none)
+        const std::vector<risk_factor_id_t> &ir_pillars(std::string_view ccy) const
+        {
+            static const std::vector<risk_factor_id_t> none;
+            auto iter = m_ir_pillars_by_ccy.find(ccy);
+            return iter != m_ir_pillars_by_ccy.end() ? iter->second : none;
+        }
+
+    private:
+        std::vector<string> m_names;
+        std::vector<risk_factor_key_t> m_keys;
+        std::unordered_map<std::string_view, risk_factor_id_t> m_ids; // views of the strings in m_names
+        std::vector<risk_factor_id_t> m_ir_pillars;
+        std::map<string, std::vector<risk_factor_id_t>, std::less<>> m_ir_pillars_by_ccy;
+    };
+
+} // namespace minirisk
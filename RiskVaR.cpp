@@ -0,0 +1,222 @@
+#include "RiskVaR.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+
+namespace minirisk
+{
+
+    scenario_reader_t::scenario_reader_t(const std::string &filename)
+        : m_is(filename), m_has_next(false)
+    {
+        MYASSERT(!m_is.fail(), "Could not open file " << filename);
+        m_has_next = read_shift();
+    }
+
+    bool scenario_reader_t::read_shift()
+    {
+        if (!(m_is >> m_next_name >> m_next_shift.first))
+            return false;
+        MYASSERT((m_is >> m_next_shift.second), "Invalid shift of " << m_next_shift.first << " in scenario " << m_next_name);
+        return true;
+    }
+
+    bool scenario_reader_t::read(var_scenario_t &scenario)
+    {
+        if (!m_has_next)
+            return false;
+        scenario.name = m_next_name;
+        scenario.shifts.clear();
+        do
+        {
+            scenario.shifts.push_back(m_next_shift);
+            m_has_next = read_shift();
+        } while (m_has_next && m_next_name == scenario.name);
+        return true;
+    }
+
+    var_level_t var_from_pnl(std::vector<double> pnl, double confidence)
+    {
+        MYASSERT(!pnl.empty(), "Cannot compute the VaR of an empty sample");
+        MYASSERT((confidence > 0.0 && confidence < 1.0), "The confidence level must be between 0 and 1, got " << confidence);
+
+        // number of scenarios in the tail (the tolerance avoids rounding 500 * 0.01 up to 6)
+        size_t k = static_cast<size_t>(std::ceil(pnl.size() * (1.0 - confidence) - 1e-9));
+        k = std::max<size_t>(1, std::min(k, pnl.size()));
+
+        // the k worst scenarios, from the worst
+        std::partial_sort(pnl.begin(), pnl.begin() + k, pnl.end());
+
+        var_level_t level;
+        level.confidence = confidence;
+        level.var = -pnl[k - 1];
+        level.es = -std::accumulate(pnl.begin(), pnl.begin() + k, 0.0) / k;
+        return level;
+    }
+
+    // size of the ranges the trades are split into, a single range without a pool
+    static size_t range_grain(size_t n, ThreadPool *pool)
+    {
+        return pool ? pool->default_grain(n) : std::max<size_t>(1, n);
+    }
+
+    // call body on consecutive ranges of [0, n) of at most grain elements, on the pool if any
+    static void for_ranges(size_t n, size_t grain, ThreadPool *pool, const std::function<void(size_t, size_t)> &body)
+    {
+        if (pool)
+            pool->parallel_for(n, grain, body);
+        else if (n > 0)
+            body(0, n);
+    }
+
+    // price of each trade in the base market, NaN if it cannot be priced
+    static std::vector<double> base_prices(const std::vector<ppricer_t> &pricers, Market &mkt, ThreadPool *pool)
+    {
+        std::vector<double> prices(pricers.size());
+        for_ranges(pricers.size(), range_grain(pricers.size(), pool), pool, [&](size_t begin, size_t end)
+                   {
+            for (size_t i = begin; i < end; ++i)
+            {
+                try
+                {
+                    prices[i] = pricers[i]->price(mkt);
+                }
+                catch (const std::exception &)
+                {
+                    prices[i] = std::numeric_limits<double>::quiet_NaN();
+                }
+            } });
+        return prices;
+    }
+
+    // The risk factors of the base market shifted as in the scenario. Shifts of risk factors
+    // never fetched by the base market are dropped, as no trade depends on them.
+    static Market::vec_risk_factor_t shifted_risk_factors(const Market &mkt, const Market::vec_risk_factor_t &shifts)
+    {
+        std::vector<risk_factor_id_t> ids;
+        ids.reserve(shifts.size());
+        for (const auto &s : shifts)
+        {
+            risk_factor_id_t id = mkt.risk_factor_id(s.first);
+            MYASSERT(id != invalid_risk_factor_id, "Unknown risk factor in scenario: " << s.first);
+            ids.push_back(id);
+        }
+
+        // the values follow the order of the shifts, skipping the risk factors not fetched
+        Market::vec_risk_factor_t values = mkt.get_risk_factors(ids);
+        size_t j = 0;
+        for (auto &v : values)
+        {
+            while (shifts[j].first != v.first)
+                ++j;
+            v.second += shifts[j++].second;
+        }
+        return values;
+    }
+
+    // Total P&L of the trades priced in the base market. Trades failing in the scenario
+    // are counted in n_errors and contribute no P&L.
+    static double scenario_pnl(const std::vector<ppricer_t> &pricers, Market &mkt, const std::vector<double> &base, const var_scenario_t &scenario, ThreadPool *pool, std::atomic<size_t> &n_errors)
+    {
+        Market scenario_mkt(mkt, shifted_risk_factors(mkt, scenario.shifts));
+
+        const size_t n = pricers.size();
+        const size_t grain = range_grain(n, pool);
+        std::vector<double> partial((n + grain - 1) / grain, 0.0);
+        for_ranges(n, grain, pool, [&](size_t begin, size_t end)
+                   {
+            double sum = 0.0;
+            size_t errors = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (std::isnan(base[i]))
+                    continue;
+                try
+                {
+                    double price = pricers[i]->price(scenario_mkt);
+                    if (std::isnan(price))
+                        ++errors;
+                    else
+                        sum += price - base[i];
+                }
+                catch (const std::exception &)
+                {
+                    ++errors;
+                }
+            }
+            partial[begin / grain] = sum;
+            if (errors > 0)
+                n_errors += errors; });
+
+        // add the partial sums in a fixed order, so that the result does not depend on the scheduling
+        return std::accumulate(partial.begin(), partial.end(), 0.0);
+    }
+
+    static var_result_t historical_var(const std::vector<ppricer_t> &pricers, Market &mkt, const std::string &scenario_file, const std::vector<double> &confidence_levels, ThreadPool *pool)
+    {
+        for (double c : confidence_levels)
+            MYASSERT((c > 0.0 && c < 1.0), "The confidence level must be between 0 and 1, got " << c);
+
+        var_result_t result;
+
+        // pricing in the base market also fetches all the risk factors the scenarios can shift
+        std::vector<double> base = base_prices(pricers, mkt, pool);
+        for (double p : base)
+        {
+            if (std::isnan(p))
+                ++result.n_errors;
+            else
+                result.base_pv += p;
+        }
+
+        // Scenarios are priced in batches of a few per thread, the trades of each scenario in
+        // parallel as well, so that only the current batch of scenarios is held in memory
+        const size_t batch_size = pool ? 2 * static_cast<size_t>(pool->size()) : 1;
+        std::vector<var_scenario_t> batch(batch_size);
+        std::vector<double> pnl(batch_size);
+        std::atomic<size_t> n_scenario_errors(0);
+        scenario_reader_t reader(scenario_file);
+        for (;;)
+        {
+            size_t n = 0;
+            while (n < batch_size && reader.read(batch[n]))
+                ++n;
+            if (n == 0)
+                break;
+
+            auto run = [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    pnl[i] = scenario_pnl(pricers, mkt, base, batch[i], pool, n_scenario_errors);
+            };
+            for_ranges(n, 1, pool, run);
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                result.scenarios.push_back(batch[i].name);
+                result.pnl.push_back(pnl[i]);
+            }
+        }
+        MYASSERT(!result.pnl.empty(), "No scenario found in file " << scenario_file);
+        result.n_scenario_errors = n_scenario_errors;
+
+        for (double c : confidence_levels)
+            result.levels.push_back(var_from_pnl(result.pnl, c));
+        return result;
+    }
+
+    var_result_t compute_historical_var(const std::vector<ppricer_t> &pricers, Market &mkt, const std::string &scenario_file, const std::vector<double> &confidence_levels)
+    {
+        return historical_var(pricers, mkt, scenario_file, confidence_levels, nullptr);
+    }
+
+    var_result_t compute_historical_var(const std::vector<ppricer_t> &pricers, Market &mkt, const std::string &scenario_file, const std::vector<double> &confidence_levels, ThreadPool &pool)
+    {
+        return historical_var(pricers, mkt, scenario_file, confidence_levels, &pool);
+    }
+
+} // namespace minirisk
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "PortfolioUtils.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace minirisk
+{
+
+// Historical scenario: the shifts of some risk factors observed over a past period.
+// Risk factors not listed are unchanged.
+struct var_scenario_t
+{
+    std::string name;                 // e.g. the date of the observation
+    Market::vec_risk_factor_t shifts; // additive shift of each risk factor
+};
+
+// Read a file of historical scenarios sequentially, one scenario at a time.
+// Each line of the file is a shift:
+//   <scenario name> <risk factor> <shift>
+// and the lines of a scenario must be contiguous, e.g.
+//   20170804 IR.1Y.USD 0.0001
+//   20170804 IR.2Y.USD -0.0002
+//   20170803 IR.1Y.USD 0.0003
+struct scenario_reader_t
+{
+    explicit scenario_reader_t(const std::string &filename);
+
+    // Replace the content of scenario with the next scenario of the file.
+    // Returns false once the end of the file has been reached.
+    bool read(var_scenario_t &scenario);
+
+private:
+    bool read_shift(); // read the next line into m_next_*
+
+    std::ifstream m_is;
+    bool m_has_next;
+    std::string m_next_name;
+    Market::risk_factor_t m_next_shift;
+};
+
+// Value at risk and expected shortfall at a confidence level, as positive losses
+struct var_level_t
+{
+    double confidence; // e.g. 0.99
+    double var;        // loss exceeded in a fraction 1 - confidence of the scenarios
+    double es;         // average loss in that tail, including the VaR scenario
+};
+
+struct var_result_t
+{
+    double base_pv = 0.0;               // total PV of the trades which could be priced in the base market
+    size_t n_errors = 0;                // trades which could not be priced in the base market, left out of the P&L
+    size_t n_scenario_errors = 0;       // repricings failing in a scenario, contributing no P&L
+    std::vector<std::string> scenarios; // scenario names, in file order
+    std::vector<double> pnl;            // portfolio P&L of each scenario
+    std::vector<var_level_t> levels;    // one per requested confidence level
+};
+
+// Historical simulation by full revaluation: every scenario of the file is applied to the
+// market as an overlay of shifted risk factors, the portfolio is repriced and only the total
+// P&L with respect to the base market is kept, so memory does not grow with trades x scenarios.
+// Scenarios are read in a streaming fashion. VaR and ES are reported at each confidence level.
+var_result_t compute_historical_var(const std::vector<ppricer_t> &pricers, Market &mkt, const std::string &scenario_file, const std::vector<double> &confidence_levels);
+
+// Same as above, repricing several scenarios at the same time on the threads of the pool,
+// each over the trades in parallel
+var_result_t compute_historical_var(const std::vector<ppricer_t> &pricers, Market &mkt, const std::string &scenario_file, const std::vector<double> &confidence_levels, ThreadPool &pool);
+
+// VaR and ES at the given confidence level of a sample of P&L
+var_level_t var_from_pnl(std::vector<double> pnl, double confidence);
+
+} // namespace minirisk
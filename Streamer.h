@@ -2,11 +2,17 @@
 
 #include <vector>
 #include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <limits>
 #include <cstdint>
+#include <string_view>
+#include <type_traits>
 
 #include "Global.h"
 #include "Date.h"
@@ -32,32 +38,105 @@ struct my_ofstream
     std::ofstream m_of;
 };
 
+// Reads the file in large blocks into a buffer. Lines and tokens are returned as views
+// into the buffer, and numbers are parsed with std::from_chars, so reading a file does not
+// allocate memory per line or per token.
 struct my_ifstream
 {
     my_ifstream(const string& fn)
-        : m_if(fn)
+        : my_ifstream(fn, 0, std::numeric_limits<size_t>::max())
+    {
+    }
+
+    // read only the bytes in [begin, end) of the file
+    my_ifstream(const string& fn, size_t begin, size_t end)
+        : m_if(fn, std::ios::binary)
+        , m_buffer(std::max<size_t>(1, std::min<size_t>(1 << 20, end - begin)))
+        , m_begin(0)
+        , m_end(0)
+        , m_pos(0)
+        , m_remaining(end - begin)
     {
         MYASSERT(!m_if.fail(), "Could not open file " << fn);
+        if (begin > 0)
+            m_if.seekg(begin);
     }
 
     bool read_line()
     {
-        std::getline(m_if, m_line);  // read a line and store it in m_line
-        m_line_stream.str(m_line);   // associate a string stream with m_line
+        for (;;) {
+            const char *first = m_buffer.data() + m_begin;
+            const char *last = m_buffer.data() + m_end;
+            const char *eol = static_cast<const char *>(std::memchr(first, '\n', last - first));
+            if (eol) {
+                m_line = std::string_view(first, eol - first);
+                m_begin += m_line.size() + 1;
+                break;
+            }
+            if (!fill_buffer()) {
+                // last line without end of line
+                m_line = std::string_view(m_buffer.data() + m_begin, m_end - m_begin);
+                m_begin = m_end;
+                break;
+            }
+        }
+        if (!m_line.empty() && m_line.back() == '\r')
+            m_line.remove_suffix(1);
+        m_pos = 0;
         return m_line.length() > 0;
     }
 
-    inline string read_token()
+    // true when all the lines have been read
+    bool eof() const
     {
-        string tmp;
-        std::getline(m_line_stream, tmp, separator);
+        return m_begin == m_end && (m_remaining == 0 || !m_if);
+    }
+
+    // Next token of the current line. The view is valid until the next call to read_line.
+    std::string_view next_token()
+    {
+        if (m_pos >= m_line.size()) {
+            m_pos = m_line.size();
+            return std::string_view();
+        }
+        size_t end = m_line.find(separator, m_pos);
+        if (end == std::string_view::npos)
+            end = m_line.size();
+        std::string_view tmp = m_line.substr(m_pos, end - m_pos);
+        m_pos = end + 1;
         return tmp;
     }
 
+    inline string read_token()
+    {
+        return string(next_token());
+    }
+
 private:
-    string m_line;
-    std::istringstream m_line_stream;
+    // Move the unread data at the beginning of the buffer and append the next block of
+    // the file, growing the buffer if a line does not fit. Returns false at end of file.
+    bool fill_buffer()
+    {
+        size_t unread = m_end - m_begin;
+        std::memmove(m_buffer.data(), m_buffer.data() + m_begin, unread);
+        m_begin = 0;
+        m_end = unread;
+        if (m_end == m_buffer.size())
+            m_buffer.resize(2 * m_buffer.size());
+        m_if.read(m_buffer.data() + m_end, std::min(m_buffer.size() - m_end, m_remaining));
+        size_t n = static_cast<size_t>(m_if.gcount());
+        m_end += n;
+        m_remaining -= n;
+        return n > 0;
+    }
+
     std::ifstream m_if;
+    std::vector<char> m_buffer;
+    size_t m_begin;           // first unread character in the buffer
+    size_t m_end;             // end of the data in the buffer
+    std::string_view m_line;  // current line
+    size_t m_pos;             // position in m_line of the next token
+    size_t m_remaining;       // bytes still to be read from the file
 };
 
 //
@@ -67,8 +146,17 @@ private:
 template <typename T>
 inline my_ifstream& operator>>(my_ifstream& is, T& v)
 {
-    string tmp = is.read_token();
-    std::istringstream(tmp) >> v;
+    std::string_view tmp = is.next_token();
+    if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+        auto res = std::from_chars(tmp.data(), tmp.data() + tmp.size(), v);
+        MYASSERT(res.ec == std::errc() && res.ptr == tmp.data() + tmp.size(), "Cannot parse an integer from '" << tmp << "'");
+    }
+    else if constexpr (std::is_same_v<T, string>) {
+        v.assign(tmp.data(), tmp.size());
+    }
+    else {
+        std::istringstream(string(tmp)) >> v;
+    }
     return is;
 }
 
@@ -95,11 +183,11 @@ inline my_ofstream& operator<<(my_ofstream& os, double v)
 
 inline my_ifstream& operator>>(my_ifstream& is, double& v)
 {
+    std::string_view tmp = is.next_token();
     uint64_t u;
-    is >> std::hex >> u;
-    union {double d; uint64_t u;} tmp;
-    tmp.u = u;
-    v = tmp.d;
+    auto res = std::from_chars(tmp.data(), tmp.data() + tmp.size(), u, 16);
+    MYASSERT(res.ec == std::errc() && res.ptr == tmp.data() + tmp.size(), "Cannot parse a hexadecimal double from '" << tmp << "'");
+    v = std::bit_cast<double>(u);
     return is;
 }
 
@@ -150,18 +238,18 @@ inline std::ostream& operator<<(std::ostream& os, const Date& d)
 
 inline my_ofstream& operator<<(my_ofstream& os, const Date& d)
 {
-    os << d.to_string(false);
+    char text[Date::text_size + 1];
+    Date::format_serial(d.get_serial(), text);
+    text[Date::text_size] = separator;
+    os.m_of.write(text, sizeof(text));
     return os;
 }
 
 inline my_ifstream& operator>>(my_ifstream& is, Date& v)
 {
-    string tmp;
-    is >> tmp;
-    unsigned y = std::atoi(tmp.substr(0, 4).c_str());
-    unsigned m = std::atoi(tmp.substr(4, 2).c_str());
-    unsigned d = std::atoi(tmp.substr(6, 2).c_str());
-    v.init(y, m, d);
+    std::string_view tmp = is.next_token();
+    MYASSERT(tmp.size() == Date::text_size, "Cannot parse a date in format YYYYMMDD from '" << tmp << "'");
+    v = Date::from_serial(Date::parse_serial(tmp.data()));
     return is;
 }
 
@@ -8,6 +8,13 @@
 using namespace minirisk;
 const std::array<unsigned, 12> days_in_month = { {31,28,31,30,31,30,31,31,30,31,30,31} };
 
+// Dates and their arithmetic are evaluated at compile time
+static_assert(Date(1900, 1, 1).get_serial() == 0, "The serial of 1-Jan-1900 must be 0");
+static_assert(20170805_date == Date(2017, 8, 5), "The date literal must match the constructor");
+static_assert(Date(2000, 3, 1) - Date(2000, 2, 28) == 2, "2000 is a leap year");
+static_assert(Date(1900, 3, 1) - Date(1900, 2, 28) == 1, "1900 is not a leap year");
+static_assert(Date(2199, 12, 31).get_serial() == Date::compute_serial(2199, 12, 31), "Constructor and compute_serial must agree");
+
 // Verify that Date class constructor throws error for 1000 random invalid dates
 void test1() {
     
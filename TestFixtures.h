@@ -0,0 +1,95 @@
+#pragma once
+
+#include "MarketDataServer.h"
+#include "PortfolioUtils.h"
+#include "TradePayment.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+
+// Data shared by the test programs and the benchmarks
+
+namespace minirisk
+{
+
+// A file removed when the object goes out of scope, so that no file is left behind,
+// even by a test which fails
+struct temp_file_t
+{
+    explicit temp_file_t(const std::string &name) : name(name) {}
+    ~temp_file_t() { std::remove(name.c_str()); }
+
+    temp_file_t(const temp_file_t &) = delete;
+    temp_file_t &operator=(const temp_file_t &) = delete;
+
+    const std::string name;
+};
+
+// currencies of the fixtures below, with their fx spot to USD
+const char *const fixture_ccys[] = {"USD", "EUR", "GBP", "JPY"};
+const double fixture_spots[] = {1.0, 1.18, 1.31, 0.009};
+
+// n random payments in the first n_ccy fixture currencies, delivered between today and
+// 10 years later (the last pillar of the curves of make_market_data), so that most dates
+// are shared by several trades
+inline portfolio_t make_payments(size_t n, const Date &today, size_t n_ccy = 4)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> quantity(-1e6, 1e6);
+    std::uniform_int_distribution<unsigned> day(0, 10 * 365);
+    std::uniform_int_distribution<size_t> ccy(0, n_ccy - 1);
+    portfolio_t portfolio;
+    for (size_t i = 0; i < n; ++i)
+    {
+        std::shared_ptr<TradePayment> p(new TradePayment);
+        p->init(fixture_ccys[ccy(rng)], quantity(rng), Date::from_serial(today.get_serial() + day(rng)));
+        portfolio.push_back(p);
+    }
+    return portfolio;
+}
+
+// write a text portfolio of n random payments in the fixture currencies, delivered
+// between 2018 and 2060
+inline void write_portfolio_file(const std::string &filename, size_t n)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> quantity(-1e6, 1e6);
+    std::uniform_int_distribution<unsigned> year(2018, 2060), month(1, 12), day(1, 28), ccy(0, 3);
+
+    portfolio_t portfolio;
+    for (size_t i = 0; i < n; ++i)
+    {
+        std::shared_ptr<TradePayment> p(new TradePayment);
+        p->init(fixture_ccys[ccy(rng)], quantity(rng), Date(year(rng), month(rng), day(rng)));
+        portfolio.push_back(p);
+    }
+    save_portfolio(filename, portfolio);
+}
+
+// market data with yield curves in the fixture currencies, with pillars from 1 week to
+// 10 years, and their fx spots
+inline std::shared_ptr<MarketDataServer> make_market_data()
+{
+    const char *tenors[] = {"1W", "1M", "2M", "3M", "6M", "9M", "1Y", "2Y", "3Y", "5Y", "10Y"};
+    temp_file_t file("fixture_risk_factors.tmp");
+    {
+        std::ofstream os(file.name);
+        for (size_t c = 0; c < 4; ++c)
+        {
+            double rate = 0.02 - 0.005 * c;
+            for (const char *tenor : tenors)
+            {
+                os << "IR." << tenor << "." << fixture_ccys[c] << " " << rate << "\n";
+                rate += 0.001;
+            }
+            if (c > 0)
+                os << "FX.SPOT." << fixture_ccys[c] << " " << fixture_spots[c] << "\n";
+        }
+    }
+    return std::shared_ptr<MarketDataServer>(new MarketDataServer(file.name));
+}
+
+} // namespace minirisk
@@ -0,0 +1,93 @@
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "MarketDataServer.h"
+#include "PortfolioIncremental.h"
+#include "PortfolioUtils.h"
+#include "TestFixtures.h"
+#include "TradePayment.h"
+
+using namespace minirisk;
+
+// Verify that a file larger than the minimum shard size is split in several non-empty shards,
+// and that the parallel loader reads the same trades as the sequential one
+void test1()
+{
+    temp_file_t file("test_portfolio.tmp");
+    const std::string &filename = file.name;
+    write_portfolio_file(filename, 200000);
+
+    std::vector<size_t> bounds = portfolio_shards(filename, 16);
+    if (bounds.size() < 3)
+        throw std::runtime_error("Test 1 Failed: the file was not split in several shards");
+    for (size_t i = 0; i + 1 < bounds.size(); ++i)
+        if (bounds[i] >= bounds[i + 1])
+            throw std::runtime_error("Test 1 Failed: shard " + std::to_string(i) + " is empty");
+
+    ThreadPool pool(4);
+    portfolio_t serial = load_portfolio(filename);
+    portfolio_t parallel = load_portfolio(filename, pool);
+    if (serial.size() != 200000 || parallel.size() != serial.size())
+        throw std::runtime_error("Test 1 Failed: the loaders read " + std::to_string(serial.size()) + " and " + std::to_string(parallel.size()) + " trades");
+    for (size_t i = 0; i < serial.size(); ++i)
+    {
+        const TradePayment &a = static_cast<const TradePayment &>(*serial[i]);
+        const TradePayment &b = static_cast<const TradePayment &>(*parallel[i]);
+        if (a.quantity() != b.quantity() || a.ccy() != b.ccy() || a.delivery_date() != b.delivery_date())
+            throw std::runtime_error("Test 1 Failed: the loaders read different trades at position " + std::to_string(i));
+    }
+
+    std::cout << "Test 1: SUCCESS (" << bounds.size() - 1 << " shards)" << std::endl;
+}
+
+// USD payment converted to EUR, which cannot be priced while the EUR spot is above 2:
+// it fails after reading the spot, without reaching the USD curve
+struct PricerCappedSpot : IPricer
+{
+    virtual double price(Market &mkt) const
+    {
+        double fx = mkt.get_fx_spot(fx_spot_name("EUR", "USD"));
+        if (fx > 2.0)
+            throw std::runtime_error("EUR spot out of range");
+        return mkt.get_discount_curve(ir_curve_discount_name("USD"))->df(Date(2020, 1, 1)) / fx;
+    }
+};
+
+// Verify that the incremental pricer follows the dependencies a trade reads once it can be
+// priced, which it did not reach when it failed
+void test2()
+{
+    temp_file_t file("test_risk_factors.tmp");
+    {
+        std::ofstream os(file.name);
+        os << "IR.1Y.USD 0.02\nIR.5Y.USD 0.03\nFX.SPOT.EUR 2.5\n";
+    }
+    std::shared_ptr<MarketDataServer> mds(new MarketDataServer(file.name));
+    Market mkt(mds, Date(2017, 8, 5));
+
+    std::vector<ppricer_t> pricers{ppricer_t(new PricerCappedSpot)};
+    incremental_pricer_t prices(pricers, mkt);
+    if (prices.n_errors() != 1 || prices.dependencies(0).size() != 1)
+        throw std::runtime_error("Test 2 Failed: the trade should fail reading only the spot");
+
+    const risk_factor_table_t &symbols = *mds->symbols();
+    mds->publish({{symbols.find("FX.SPOT.EUR"), 1.25}});
+    if (prices.refresh() != 1 || prices.n_errors() != 0 || prices.dependencies(0).size() != 3)
+        throw std::runtime_error("Test 2 Failed: the trade should be priced, depending on the spot and the curve");
+
+    double before = prices.total();
+    mds->publish({{symbols.find("IR.5Y.USD"), 0.04}});
+    if (prices.refresh() != 1 || !(prices.total() < before))
+        throw std::runtime_error("Test 2 Failed: the trade was not repriced when the curve moved");
+
+    std::cout << "Test 2: SUCCESS" << std::endl;
+}
+
+int main()
+{
+    test1();
+    test2();
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "MarketDataServer.h"
+#include "PortfolioUtils.h"
+#include "RiskAAD.h"
+#include "TestFixtures.h"
+#include "TradePayment.h"
+
+using namespace minirisk;
+
+// Verify that the adjoint PV01 matches the bucketed finite differences, risk factor by risk factor,
+// including the trades which cannot be priced
+void test1()
+{
+    const Date today = 20170805_date;
+    Market mkt(make_market_data(), today);
+
+    // payments in USD and EUR within the curves, plus one in the past and one beyond the last pillar
+    portfolio_t portfolio = make_payments(200, today, 2);
+    for (const Date &d : {Date(2017, 1, 1), Date(2040, 1, 1)})
+    {
+        std::shared_ptr<TradePayment> p(new TradePayment);
+        p->init("USD", 1e6, d);
+        portfolio.push_back(p);
+    }
+
+    // the bucketed PV01 bumps the risk factors fetched by a first pricing
+    auto pricers = get_pricers(portfolio);
+    compute_prices(pricers, mkt);
+    auto bucketed = compute_pv01_bucketed(pricers, mkt);
+    auto aad = compute_pv01_aad(portfolio, mkt);
+
+    std::map<std::string, const portfolio_values_t *> aad_by_name;
+    for (const auto &f : aad)
+        aad_by_name[f.first] = &f.second;
+
+    if (bucketed.size() != 22)
+        throw std::runtime_error("Test 1 Failed: " + std::to_string(bucketed.size()) + " bucketed PV01 instead of 22");
+    for (const auto &f : bucketed)
+    {
+        auto iter = aad_by_name.find(f.first);
+        if (iter == aad_by_name.end())
+            throw std::runtime_error("Test 1 Failed: no adjoint PV01 for " + f.first);
+        for (size_t i = 0; i < portfolio.size(); ++i)
+        {
+            double fd = f.second[i].first, adj = (*iter->second)[i].first;
+            bool ok = std::isnan(fd) ? std::isnan(adj) : std::abs(fd - adj) <= 1e-6 * (1.0 + std::abs(fd));
+            if (!ok)
+                throw std::runtime_error("Test 1 Failed: PV01 of trade " + std::to_string(i) + " to " + f.first + " is " + std::to_string(adj) + " by AAD and " + std::to_string(fd) + " by finite differences");
+        }
+    }
+
+    std::cout << "Test 1: SUCCESS" << std::endl;
+}
+
+// distance in units in the last place between two doubles of the same sign
+uint64_t ulps(double a, double b)
+{
+    int64_t d = std::bit_cast<int64_t>(a) - std::bit_cast<int64_t>(b);
+    return d < 0 ? -d : d;
+}
+
+// the message of the exception thrown by f, empty if none
+template <typename F>
+std::string error_of(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const std::exception &e)
+    {
+        return e.what();
+    }
+    return "";
+}
+
+// Verify that df_batch gives the discount factors of df on every day of the curve, with and
+// without the dense grid, and fails with the error of df for the first invalid date
+void test2()
+{
+#if defined(__AVX2__)
+    const uint64_t max_ulps = 2;
+#else
+    const uint64_t max_ulps = 0;
+#endif
+
+    std::shared_ptr<const MarketDataServer> mds = make_market_data();
+    const Date today = 20170805_date;
+
+    std::vector<Date> dates;
+    for (unsigned d = 0; d <= 10 * 365; ++d)
+        dates.push_back(Date::from_serial(today.get_serial() + d));
+
+    for (bool grid : {false, true})
+    {
+        Market mkt(mds, today);
+        mkt.set_df_grid(grid);
+        const ICurveDiscount &disc = mkt.discount_curve(ir_curve_discount_name("USD"));
+
+        std::vector<double> dfs(dates.size());
+        disc.df_batch(dates, dfs);
+        for (size_t i = 0; i < dates.size(); ++i)
+        {
+            double df = disc.df(dates[i]);
+            if (ulps(df, dfs[i]) > max_ulps)
+                throw std::runtime_error("Test 2 Failed: df_batch gave " + std::to_string(dfs[i]) + " instead of " + std::to_string(df) + " on " + dates[i].to_string());
+        }
+
+        // a date in the past and one beyond the last pillar, in both orders, and two dates in the past
+        const Date invalid[][2] = {{Date(2017, 1, 1), Date(2040, 1, 1)}, {Date(2040, 1, 1), Date(2017, 1, 1)}, {Date(2017, 1, 1), Date(2016, 6, 1)}};
+        for (const auto &t : invalid)
+        {
+            std::vector<Date> batch{today, t[0], today, t[1]};
+            std::vector<double> batch_dfs(batch.size());
+            std::string expected = error_of([&]() { disc.df(t[0]); });
+            std::string actual = error_of([&]() { disc.df_batch(batch, batch_dfs); });
+            if (expected.empty() || actual != expected)
+                throw std::runtime_error("Test 2 Failed: df_batch reported \"" + actual + "\" instead of \"" + expected + "\"");
+        }
+    }
+
+    std::cout << "Test 2: SUCCESS" << std::endl;
+}
+
+int main()
+{
+    test1();
+    test2();
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <limits>
+
+namespace minirisk
+{
+
+    namespace
+    {
+        const size_t no_worker = std::numeric_limits<size_t>::max();
+
+        // identifies the pool and the queue owned by the current thread, if it is a worker
+        thread_local const ThreadPool *tl_pool = nullptr;
+        thread_local size_t tl_worker = no_worker;
+
+        // state shared by all the chunks of one parallel_for call
+        struct batch_t
+        {
+            explicit batch_t(size_t n) : m_remaining(n) {}
+            std::atomic<size_t> m_remaining;
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            std::exception_ptr m_error;
+        };
+    }
+
+    ThreadPool::ThreadPool(unsigned nthreads)
+        : m_pending(0), m_stop(false)
+    {
+        if (nthreads == 0)
+            nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned i = 0; i < nthreads; ++i)
+            m_queues.emplace_back(new queue_t);
+        for (unsigned i = 0; i < nthreads; ++i)
+            m_threads.emplace_back(&ThreadPool::worker, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto &t : m_threads)
+            t.join();
+    }
+
+    size_t ThreadPool::default_grain(size_t n) const
+    {
+        size_t nchunks = 8 * static_cast<size_t>(std::max(1u, size()));
+        return std::max<size_t>(1, (n + nchunks - 1) / nchunks);
+    }
+
+    void ThreadPool::push(size_t q, task_t &&task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_queues[q]->m_mutex);
+            m_queues[q]->m_tasks.push_back(std::move(task));
+        }
+        ++m_pending;
+    }
+
+    bool ThreadPool::pop(size_t q, task_t &task)
+    {
+        std::lock_guard<std::mutex> lock(m_queues[q]->m_mutex);
+        if (m_queues[q]->m_tasks.empty())
+            return false;
+        task = std::move(m_queues[q]->m_tasks.back());
+        m_queues[q]->m_tasks.pop_back();
+        --m_pending;
+        return true;
+    }
+
+    bool ThreadPool::steal(size_t q, task_t &task)
+    {
+        // visit the other queues starting from the neighbour, to spread thieves around
+        const size_t n = m_queues.size();
+        for (size_t k = 1; k <= n; ++k)
+        {
+            queue_t &victim = *m_queues[(q + k) % n];
+            std::lock_guard<std::mutex> lock(victim.m_mutex);
+            if (!victim.m_tasks.empty())
+            {
+                task = std::move(victim.m_tasks.front());
+                victim.m_tasks.pop_front();
+                --m_pending;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::run_one(size_t q)
+    {
+        task_t task;
+        bool found = (q != no_worker && pop(q, task)) || steal(q == no_worker ? 0 : q, task);
+        if (found)
+            task();
+        return found;
+    }
+
+    void ThreadPool::worker(size_t q)
+    {
+        tl_pool = this;
+        tl_worker = q;
+        for (;;)
+        {
+            if (run_one(q))
+                continue;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]()
+                      { return m_stop || m_pending.load() > 0; });
+            if (m_stop && m_pending.load() == 0)
+                return;
+        }
+    }
+
+    void ThreadPool::parallel_for(size_t n, size_t grain, const std::function<void(size_t, size_t)> &body)
+    {
+        if (n == 0)
+            return;
+        grain = std::max<size_t>(1, grain);
+        const size_t nchunks = (n + grain - 1) / grain;
+        if (nchunks == 1)
+        {
+            body(0, n);
+            return;
+        }
+
+        // a worker pushes on its own queue and lets the others steal,
+        // any other thread deals the chunks round robin over all queues
+        const size_t self = (tl_pool == this) ? tl_worker : no_worker;
+        auto batch = std::make_shared<batch_t>(nchunks);
+        for (size_t c = 0; c < nchunks; ++c)
+        {
+            size_t begin = c * grain, end = std::min(n, begin + grain);
+            push(self != no_worker ? self : c % m_queues.size(), [batch, &body, begin, end]()
+                 {
+                    try
+                    {
+                        body(begin, end);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(batch->m_mutex);
+                        if (!batch->m_error)
+                            batch->m_error = std::current_exception();
+                    }
+                    if (batch->m_remaining.fetch_sub(1) == 1)
+                    {
+                        std::lock_guard<std::mutex> lock(batch->m_mutex);
+                        batch->m_cv.notify_all();
+                    } });
+        }
+        {
+            // taking the lock makes sure no worker is between testing m_pending and going to sleep
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_cv.notify_all();
+
+        // help with pending work while waiting, so that nested calls cannot starve the pool
+        while (batch->m_remaining.load() > 0)
+        {
+            if (run_one(self))
+                continue;
+            std::unique_lock<std::mutex> lock(batch->m_mutex);
+            batch->m_cv.wait_for(lock, std::chrono::milliseconds(1), [&batch]()
+                                 { return batch->m_remaining.load() == 0; });
+        }
+
+        if (batch->m_error)
+            std::rethrow_exception(batch->m_error);
+    }
+
+} // namespace minirisk
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace minirisk
+{
+
+    // Fixed size pool of worker threads with one task queue per worker.
+    // A worker pops tasks from the back of its own queue and, when it runs dry,
+    // steals from the front of the other queues.
+    // Threads waiting for a parallel_for to complete help executing pending tasks,
+    // so parallel_for can be safely nested (e.g. parallel scenarios, each pricing in parallel).
+    struct ThreadPool
+    {
+        // nthreads == 0 means one thread per hardware core
+        explicit ThreadPool(unsigned nthreads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        unsigned size() const { return static_cast<unsigned>(m_threads.size()); }
+
+        // Call body(begin, end) on consecutive sub-ranges of [0, n) of at most grain elements.
+        // Blocks until all sub-ranges have been processed. If any call throws, the first
+        // exception is rethrown to the caller once all the other sub-ranges have completed.
+        void parallel_for(size_t n, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+        // grain size splitting n elements in a few chunks per thread, to balance the load
+        size_t default_grain(size_t n) const;
+
+    private:
+        typedef std::function<void()> task_t;
+
+        struct queue_t
+        {
+            std::mutex m_mutex;
+            std::deque<task_t> m_tasks;
+        };
+
+        void push(size_t q, task_t &&task);
+        bool pop(size_t q, task_t &task);
+        bool steal(size_t q, task_t &task);
+        bool run_one(size_t q);
+        void worker(size_t q);
+
+        std::vector<std::unique_ptr<queue_t>> m_queues;
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::atomic<size_t> m_pending;
+        bool m_stop;
+    };
+
+} // namespace minirisk
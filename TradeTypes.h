@@ -0,0 +1,80 @@
+#pragma once
+
+#include "PricerPayment.h"
+#include "TradePayment.h"
+
+#include <variant>
+#include <vector>
+
+namespace minirisk
+{
+
+// A trade type and the pricer of its trades, which must be constructible from a trade
+template <typename Trade, typename Pricer>
+struct trade_type_t
+{
+    typedef Trade trade_t;
+    typedef Pricer pricer_t;
+};
+
+// Compile-time list of trade types, from which the code dispatching on the type of a trade
+// is generated instead of being written by hand for every type
+template <typename... Types>
+struct trade_type_list_t
+{
+    // one of the trades, or one of the pricers, stored by value
+    typedef std::variant<typename Types::trade_t...> trade_variant_t;
+    typedef std::variant<typename Types::pricer_t...> pricer_variant_t;
+
+    // a new default constructed trade of the type with the given id, null if the id is unknown
+    static ptrade_t make_trade(guid_t id)
+    {
+        ptrade_t p;
+        ((id == Types::trade_t::m_id && (p.reset(new typename Types::trade_t), true)) || ...);
+        return p;
+    }
+
+    // Append the pricer of a trade to the pricers, built in place.
+    // Returns false if the type of the trade is not in the list.
+    static bool append_pricer(const ITrade &trade, std::vector<pricer_variant_t> &pricers)
+    {
+        auto append = [&]<typename Type>()
+        {
+            pricers.emplace_back(std::in_place_type<typename Type::pricer_t>, static_cast<const typename Type::trade_t &>(trade));
+            return true;
+        };
+        return ((trade.id() == Types::trade_t::m_id && append.template operator()<Types>()) || ...);
+    }
+
+    // Read the details of a trade of the type with the given id (which has already been read)
+    // and append its pricer to the pricers, the trade itself being a local object.
+    // Returns false if the id is unknown.
+    static bool load_pricer(guid_t id, my_ifstream &is, std::vector<pricer_variant_t> &pricers)
+    {
+        auto load = [&]<typename Type>()
+        {
+            typename Type::trade_t trade;
+            trade.load(is);
+            pricers.emplace_back(std::in_place_type<typename Type::pricer_t>, trade);
+            return true;
+        };
+        return ((id == Types::trade_t::m_id && load.template operator()<Types>()) || ...);
+    }
+
+    // Price with the pricer held by the variant. The call is qualified with the type of the
+    // pricer, so it is bound at compile time rather than through the virtual table.
+    static double price(const pricer_variant_t &pricer, Market &mkt)
+    {
+        return std::visit([&mkt](const auto &p)
+                          {
+            typedef std::decay_t<decltype(p)> pricer_t;
+            return p.pricer_t::price(mkt); }, pricer);
+    }
+};
+
+// All the trade types. A new trade type is registered by adding it to this list.
+typedef trade_type_list_t<
+    trade_type_t<TradePayment, PricerPayment>>
+    trade_types_t;
+
+} // namespace minirisk
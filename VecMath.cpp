@@ -0,0 +1,97 @@
+#include "VecMath.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace minirisk
+{
+
+#if defined(__AVX2__)
+
+    namespace
+    {
+        // exp(x) = 2^k * exp(r), with k = round(x / ln2) and |r| <= ln2 / 2.
+        // ln2 is split in two parts so that k * ln2_hi is exact.
+        const double log2e = 1.4426950408889634;
+        const double ln2_hi = 6.93147180369123816490e-01;
+        const double ln2_lo = 1.90821492927058770002e-10;
+
+        // outside this range the result is denormal or overflows, and std::exp is used instead
+        const double max_arg = 709.0;
+        const double min_arg = -708.0;
+
+        // Taylor coefficients 1/k! of exp(r) for k = 13 .. 0, whose truncation error is below 1e-17 for |r| <= ln2 / 2
+        const double coeffs[] = {
+            1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0,
+            1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0};
+
+        // scalar version of the kernel, used for the elements not filling a whole vector,
+        // so that results do not depend on the position of an element in the array
+        double exp_kernel(double x)
+        {
+            if (!(x >= min_arg && x <= max_arg))
+                return std::exp(x);
+            double k = std::nearbyint(x * log2e);
+            double r = (x - k * ln2_hi) - k * ln2_lo;
+            double p = coeffs[0];
+            for (size_t i = 1; i < sizeof(coeffs) / sizeof(coeffs[0]); ++i)
+                p = p * r + coeffs[i];
+            int64_t bits = (static_cast<int64_t>(k) + 1023) << 52;
+            double scale;
+            std::memcpy(&scale, &bits, sizeof(scale));
+            return p * scale;
+        }
+    }
+
+    void vec_exp(const double *x, double *y, size_t n)
+    {
+        const __m256d vlog2e = _mm256_set1_pd(log2e);
+        const __m256d vln2_hi = _mm256_set1_pd(ln2_hi);
+        const __m256d vln2_lo = _mm256_set1_pd(ln2_lo);
+        const __m256d vmax = _mm256_set1_pd(max_arg);
+        const __m256d vmin = _mm256_set1_pd(min_arg);
+        const __m256i vbias = _mm256_set1_epi64x(1023);
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d vx = _mm256_loadu_pd(x + i);
+            int outside = _mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(vx, vmin, _CMP_NGE_UQ), _mm256_cmp_pd(vx, vmax, _CMP_NLE_UQ)));
+            if (outside)
+            {
+                for (size_t j = i; j < i + 4; ++j)
+                    y[j] = exp_kernel(x[j]);
+                continue;
+            }
+            __m256d k = _mm256_round_pd(_mm256_mul_pd(vx, vlog2e), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256d r = _mm256_sub_pd(_mm256_sub_pd(vx, _mm256_mul_pd(k, vln2_hi)), _mm256_mul_pd(k, vln2_lo));
+
+            __m256d p = _mm256_set1_pd(coeffs[0]);
+            for (size_t j = 1; j < sizeof(coeffs) / sizeof(coeffs[0]); ++j)
+                p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(coeffs[j]));
+
+            // build 2^k directly in the exponent bits
+            __m256i ki = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+            __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(ki, vbias), 52));
+            _mm256_storeu_pd(y + i, _mm256_mul_pd(p, scale));
+        }
+        for (; i < n; ++i)
+            y[i] = exp_kernel(x[i]);
+    }
+
+#else
+
+    void vec_exp(const double *x, double *y, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            y[i] = std::exp(x[i]);
+    }
+
+#endif
+
+} // namespace minirisk
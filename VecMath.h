@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+namespace minirisk
+{
+
+    // y[i] = exp(x[i]) for i in [0, n). x and y may be the same array.
+    // When compiled with AVX2 enabled (e.g. -mavx2 or -march=native) four values are computed
+    // at a time with a polynomial kernel accurate to a couple of ulps over the range of
+    // discount factor exponents, otherwise it falls back to std::exp.
+    void vec_exp(const double *x, double *y, size_t n);
+
+} // namespace minirisk